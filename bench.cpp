@@ -0,0 +1,392 @@
+/*--------------------------------------------------------------------
+    DICE 0.9a  –  bench.cpp
+    Throughput benchmark: runs each game headless with scripted input
+    and reports speed, event queue traffic, build time and memory as
+    JSON, optionally compared against an earlier run
+--------------------------------------------------------------------*/
+
+#include <phoenix.hpp>
+#include <nall/platform.hpp>
+
+using namespace nall;
+using namespace phoenix;
+
+#include "circuit.h"
+#include "circuit_desc.h"
+#include "game_list.h"
+
+#include "chips/video_null.h"
+#include "chips/audio_null.h"
+#include "chips/input_injected.h"
+
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+/*====================================================================
+    Global helpers (referenced by chips/rom.cpp)
+====================================================================*/
+static nall::string app_path;
+
+const nall::string& application_path()  { return app_path; }
+Window&             application_window(){ return Window::none(); }
+
+static void usage()
+{
+    printf("usage: dice_bench [game...] [-seconds N] [-queue heap|calendar] [-noimage] [-noadaptive]\n");
+    printf("                  [-o file] [-baseline file [-threshold percent]]\n");
+    printf("games:");
+    for(const GameDesc& g : game_list) printf(" %s", g.command_line);
+    printf("\n");
+}
+
+/*====================================================================
+    One game, run in forked processes so each run starts from pristine
+    static chip descriptors and its peak RSS is its own
+====================================================================*/
+struct BenchResult
+{
+    unsigned chips;
+    bool     from_image;
+    double   construct_ms;
+    double   emulated;      // Seconds
+    double   real;          // Seconds
+    uint64_t events;
+    uint64_t queue_pushes;
+    uint64_t queue_pops;
+    unsigned peak_queue;
+    long     rss_kb;        // Peak, after building and running
+};
+
+// Scripted play (InputInjected::play()) on a fresh build of g. Timed with profiling off; with it on, only
+// the queue traffic counts, profiling slows the event loop down.
+static bool run_script(const GameDesc& g, unsigned queue, bool images, bool adaptive, double seconds, bool profiling,
+                       BenchResult& result)
+{
+    int fd[2];
+    if(pipe(fd) != 0) return false;
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        close(fd[0]);
+        if(!freopen("/dev/null", "w", stdout)) _exit(1); // Hide netlist warnings
+
+        Settings settings;
+        settings.throttle = false;
+        settings.event_queue = queue;
+        settings.netlist_images = images;
+        settings.tuned_hints = false; // Sizes as the netlist has them, whatever --tune-hints left on this machine
+        settings.adaptive_optimization = adaptive;
+
+        InputInjected input;
+        VideoNull video;
+        AudioNull audio;
+
+        srand(0);
+        Circuit* circuit = new Circuit(settings, input, video, audio, g.desc, g.command_line);
+
+        // Queue traffic of the run only, the build queues the first events
+        circuit->setProfiling(profiling);
+        uint64_t start_events = circuit->event_count;
+
+        RealTimeClock real_time;
+        unsigned steps = unsigned(ceil(seconds / InputInjected::PLAY_STEP));
+        for(unsigned i = 0; i < steps; i++)
+        {
+            input.play(settings, i * InputInjected::PLAY_STEP);
+            circuit->run(InputInjected::PLAY_STEP / Circuit::timescale);
+        }
+
+        BenchResult r;
+        memset(&r, 0, sizeof(r));
+        r.real         = real_time.get_usecs() * 1.0e-6;
+        r.emulated     = circuit->global_time * Circuit::timescale;
+        r.chips        = circuit->chips.size();
+        r.from_image   = circuit->build_times.from_image;
+        r.construct_ms = circuit->build_times.total * 1.0e3;
+        r.events       = circuit->event_count - start_events;
+        r.queue_pops   = r.events;
+        if(profiling)
+        {
+            r.queue_pushes = circuit->profiler->total(&ChipProfiler::Counters::pushes);
+            r.peak_queue   = circuit->profiler->queue_peak;
+        }
+
+        struct rusage usage;
+        r.rss_kb = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+
+        if(write(fd[1], &r, sizeof(r)) != sizeof(r)) _exit(1);
+        _exit(0);
+    }
+
+    close(fd[1]);
+    bool ok = pid > 0 && read(fd[0], &result, sizeof(result)) == sizeof(result);
+    close(fd[0]);
+    if(pid > 0) waitpid(pid, nullptr, 0);
+
+    return ok;
+}
+
+static bool bench_game(const GameDesc& g, unsigned queue, bool images, bool adaptive, double seconds, BenchResult& result)
+{
+    BenchResult counted;
+    if(!run_script(g, queue, images, adaptive, seconds, false, result) ||
+       !run_script(g, queue, images, adaptive, seconds, true, counted))
+        return false;
+
+    result.queue_pushes = counted.queue_pushes;
+    result.peak_queue   = counted.peak_queue;
+    return true;
+}
+
+/*====================================================================
+    JSON output, and just enough of a reader for baselines written
+    by write_json()
+====================================================================*/
+struct GameResult
+{
+    const GameDesc* game;
+    BenchResult r;
+};
+
+static void write_json(FILE* f, const std::vector<GameResult>& results, double seconds, unsigned queue, bool images,
+                       bool adaptive)
+{
+    fprintf(f, "{\n");
+    fprintf(f, "  \"seconds\": %g,\n", seconds);
+    fprintf(f, "  \"queue\": \"%s\",\n", queue == Settings::CALENDAR_QUEUE ? "calendar" : "heap");
+    fprintf(f, "  \"netlist_images\": %s, \"tuned_hints\": false, \"adaptive_optimization\": %s,\n",
+            images ? "true" : "false", adaptive ? "true" : "false");
+    fprintf(f, "  \"games\": [\n");
+
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        const GameDesc& g = *results[i].game;
+        const BenchResult& r = results[i].r;
+
+        fprintf(f, "    { \"game\": \"%s\", \"name\": \"", g.command_line);
+        for(const char* c = g.name; *c; c++)
+        {
+            if(*c == '"' || *c == '\\') fputc('\\', f);
+            fputc(*c, f);
+        }
+        fprintf(f, "\", \"chips\": %u, \"from_image\": %s, \"construct_ms\": %.3f,\n",
+                r.chips, r.from_image ? "true" : "false", r.construct_ms);
+        fprintf(f, "      \"emulated_s\": %.6f, \"real_s\": %.6f, \"speed\": %.4f, \"events\": %llu, \"events_per_sec\": %.0f,\n",
+                r.emulated, r.real, r.emulated / r.real, (unsigned long long)r.events, r.events / r.real);
+        fprintf(f, "      \"queue_pushes\": %llu, \"queue_pops\": %llu, \"peak_queue_depth\": %u, \"rss_kb\": %ld }%s\n",
+                (unsigned long long)r.queue_pushes, (unsigned long long)r.queue_pops, r.peak_queue, r.rss_kb,
+                i + 1 < results.size() ? "," : "");
+    }
+
+    fprintf(f, "  ]\n");
+    fprintf(f, "}\n");
+}
+
+struct Baseline
+{
+    std::string game;
+    double speed, events_per_sec, construct_ms;
+};
+
+// Value of "key" in a flat JSON object, false if it isn't there
+static bool json_value(const std::string& obj, const char* key, std::string& value)
+{
+    std::string quoted = std::string("\"") + key + "\"";
+    size_t p = obj.find(quoted);
+    if(p == std::string::npos) return false;
+
+    p = obj.find(':', p + quoted.size());
+    if(p == std::string::npos) return false;
+    p = obj.find_first_not_of(" \t\r\n", p + 1);
+    if(p == std::string::npos) return false;
+
+    if(obj[p] == '"')
+    {
+        size_t end = obj.find('"', p + 1);
+        if(end == std::string::npos) return false;
+        value = obj.substr(p + 1, end - p - 1);
+    }
+    else
+        value = obj.substr(p, obj.find_first_of(",}\r\n", p) - p);
+
+    return true;
+}
+
+static bool read_baseline(const char* path, std::vector<Baseline>& baseline)
+{
+    FILE* f = fopen(path, "rb");
+    if(f == NULL) return false;
+
+    std::string text;
+    char buf[4096];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        text.append(buf, n);
+    fclose(f);
+
+    size_t games = text.find("\"games\"");
+    if(games == std::string::npos) return false;
+
+    // One object per game, no nesting
+    for(size_t p = text.find('{', games); p != std::string::npos; p = text.find('{', p))
+    {
+        size_t end = text.find('}', p);
+        if(end == std::string::npos) return false;
+        std::string obj = text.substr(p, end - p);
+        p = end;
+
+        Baseline b;
+        std::string speed, events, construct;
+        if(!json_value(obj, "game", b.game) || !json_value(obj, "speed", speed) ||
+           !json_value(obj, "events_per_sec", events) || !json_value(obj, "construct_ms", construct))
+            return false;
+
+        b.speed = atof(speed.c_str());
+        b.events_per_sec = atof(events.c_str());
+        b.construct_ms = atof(construct.c_str());
+        baseline.push_back(b);
+    }
+
+    return true;
+}
+
+// Comparison on stderr, stdout stays JSON. false if a game got slower than threshold allows.
+static bool compare(const std::vector<GameResult>& results, const std::vector<Baseline>& baseline, double threshold)
+{
+    fprintf(stderr, "%-16s %10s %10s %8s %14s %14s %8s %9s\n", "game", "base speed", "speed", "change",
+            "base ev/s", "ev/s", "change", "build ms");
+
+    bool ok = true;
+    for(const GameResult& gr : results)
+    {
+        const Baseline* b = nullptr;
+        for(const Baseline& bl : baseline)
+            if(bl.game == gr.game->command_line)
+                b = &bl;
+
+        const BenchResult& r = gr.r;
+        double speed = r.emulated / r.real, events_per_sec = r.events / r.real;
+
+        if(b == nullptr || b->events_per_sec <= 0.0)
+        {
+            fprintf(stderr, "%-16s %10s %10.2f %8s %14s %14.0f %8s %9.2f  (not in baseline)\n", gr.game->name, "-",
+                    speed, "-", "-", events_per_sec, "-", r.construct_ms);
+            continue;
+        }
+
+        double speed_change = (speed / b->speed - 1.0) * 100.0;
+        double events_change = (events_per_sec / b->events_per_sec - 1.0) * 100.0;
+        const char* verdict = "";
+        if(events_change < -threshold)
+        {
+            verdict = "  slower";
+            ok = false;
+        }
+        else if(events_change > threshold)
+            verdict = "  faster";
+
+        fprintf(stderr, "%-16s %10.2f %10.2f %+7.1f%% %14.0f %14.0f %+7.1f%% %9.2f%s\n", gr.game->name, b->speed, speed,
+                speed_change, b->events_per_sec, events_per_sec, events_change, r.construct_ms, verdict);
+    }
+
+    return ok;
+}
+
+/*====================================================================
+    main()
+====================================================================*/
+int main(int argc, char** argv)
+{
+    app_path = dir(realpath(argv[0]));
+
+    double      seconds    = 10.0;
+    unsigned    queue      = Settings::HEAP_QUEUE;
+    bool        images     = true;
+    bool        adaptive   = true;
+    const char* out_path   = nullptr;
+    const char* base_path  = nullptr;
+    double      threshold  = 5.0;
+
+    std::vector<const GameDesc*> games;
+
+    /* ---------- parse CLI flags ---------- */
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "-seconds") == 0 && i+1 < argc)
+            seconds = atof(argv[++i]);
+        else if(strcmp(argv[i], "-queue") == 0 && i+1 < argc)
+            queue = strcmp(argv[++i], "calendar") == 0 ? Settings::CALENDAR_QUEUE : Settings::HEAP_QUEUE;
+        else if(strcmp(argv[i], "-noimage") == 0)
+            images = false;
+        else if(strcmp(argv[i], "-noadaptive") == 0)
+            adaptive = false;
+        else if(strcmp(argv[i], "-o") == 0 && i+1 < argc)
+            out_path = argv[++i];
+        else if(strcmp(argv[i], "-baseline") == 0 && i+1 < argc)
+            base_path = argv[++i];
+        else if(strcmp(argv[i], "-threshold") == 0 && i+1 < argc)
+            threshold = atof(argv[++i]);
+        else
+        {
+            const GameDesc* game = nullptr;
+            for(const GameDesc& g : game_list)
+                if(strcmp(argv[i], g.command_line) == 0)
+                    game = &g;
+
+            if(game == nullptr)
+            {
+                usage();
+                return 1;
+            }
+            games.push_back(game);
+        }
+    }
+
+    if(games.empty())
+        for(const GameDesc& g : game_list)
+            games.push_back(&g);
+
+    std::vector<Baseline> baseline;
+    if(base_path && !read_baseline(base_path, baseline))
+    {
+        fprintf(stderr, "Unable to read baseline %s\n", base_path);
+        return 1;
+    }
+
+    std::vector<GameResult> results;
+    for(const GameDesc* g : games)
+    {
+        GameResult gr = { g };
+        if(!bench_game(*g, queue, images, adaptive, seconds, gr.r))
+        {
+            fprintf(stderr, "%-16s failed\n", g->name);
+            continue;
+        }
+
+        fprintf(stderr, "%-16s %7.2fx %12.0f ev/s\n", g->name, gr.r.emulated / gr.r.real, gr.r.events / gr.r.real);
+        results.push_back(gr);
+    }
+
+    FILE* out = stdout;
+    if(out_path && (out = fopen(out_path, "w")) == NULL)
+    {
+        fprintf(stderr, "Unable to write %s\n", out_path);
+        return 1;
+    }
+    write_json(out, results, seconds, queue, images, adaptive);
+    if(out != stdout) fclose(out);
+
+    if(base_path && !compare(results, baseline, threshold))
+        return 2;
+
+    return results.size() == games.size() ? 0 : 1;
+}
@@ -1,5 +1,10 @@
 #include <cstdio>
 #include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+#include <cstring>
+#include <nall/serializer.hpp>
 
 #include "chip.h"
 #include "chip_desc.h"
@@ -22,7 +27,30 @@
 
 extern CUSTOM_LOGIC( CLK_GATE );
 
-void Chip::initialize()
+// Adaptive de-optimization, see Chip::review_optimization(). A step is one pass of
+// the cycle optimizer's loops, the optimizer pays if an event is saved for every
+// OPTIMIZER_STEPS_PER_EVENT of them.
+static const uint64_t OPTIMIZER_REVIEW_STEPS = 1 << 14;
+static const uint64_t OPTIMIZER_REVIEW_TIME = 16666667000ull; // ps, a frame: at least this long between reviews
+static const uint64_t OPTIMIZER_STEPS_PER_EVENT = 64;
+static const int OPTIMIZER_STRIKES = 8;        // Losing reviews in a row before disabling it
+static const uint32_t REOPTIMIZE_EVENTS = 1 << 15; // Doubled each time it is disabled...
+static const int MAX_DEOPTIMIZATIONS = 4;      // ... and not enabled again after this many
+
+// Events from i to the end of q
+template <typename T> static uint32_t events_since(const cirque<T>& q, const typename cirque<T>::index& i)
+{
+    return (q.end() - i.getRawIndex()).getRawIndex();
+}
+
+void* Chip::operator new(size_t size)
+{
+    void* p;
+    if(posix_memalign(&p, CACHE_LINE_SIZE, size)) throw std::bad_alloc();
+    return p;
+}
+
+bool Chip::initialize()
 {
 	int new_out = output;
 
@@ -34,7 +62,7 @@ void Chip::initialize()
 	switch(type) {
 		case SIMPLE_CHIP: new_out = (lut_data >> inputs) & 1; break;
 		case BASIC_CHIP:  new_out = (lut[inputs >> 5] >> (inputs & 0x1f)) & 1; break;
-        case CUSTOM_CHIP: custom_update(this, 0); return;
+        case CUSTOM_CHIP: custom_update(this, 0); return false;
 	}
 
 	if(new_out != output)
@@ -46,21 +74,125 @@ void Chip::initialize()
         else
             inputs &= ~prev_output_mask;
 
-        for(LinkIterator it = output_links.begin(); it != output_links.end(); ++it)
-            it->chip->inputs ^= it->mask;
+        Chip* const* chips = circuit->chips.data();
+        for(uint32_t i = 0; i < output_count; i++)
+            chips[fanout[i].chip]->inputs ^= fanout[i].mask;
 
-        for(LinkIterator it = output_links.begin(); it != output_links.end(); ++it)
-        {
-            if(it->chip == this) continue;
-            it->chip->initialize();
-        }
+        return true;
+	}
+
+    return false;
+}
+
+struct LutPoolState
+{
+    std::mutex mutex;
+    std::map<std::pair<const ChipDesc*, const void*>, LutPool::Entry> entries;
+    size_t bytes = 0;
+};
+
+static LutPoolState& lut_pool()
+{
+    static LutPoolState* pool = new LutPoolState; // Outlives every circuit, never freed
+    return *pool;
+}
+
+LutPool::Entry LutPool::get(const ChipDesc* desc, const void* key, void* custom_data, int lut_size)
+{
+    LutPoolState& pool = lut_pool();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+
+    auto found = pool.entries.find(std::make_pair(desc, key));
+    if(found != pool.entries.end()) return found->second;
+
+    int num_input_pins;
+    for(num_input_pins = 0; desc->input_pins[num_input_pins] != 0; num_input_pins++);
+
+    Entry entry = { 0, NULL };
+    uint32_t* lut = NULL;
+    if(lut_size > 6)
+    {
+        lut = new uint32_t[1 << (lut_size-5)];
+        memset(lut, 0, sizeof(uint32_t)*(1 << (lut_size-5)));
+        pool.bytes += sizeof(uint32_t)*(1 << (lut_size-5));
+    }
+
+	// Fill the LUT
+	for(int i = 0; i < (1 << lut_size); i++)
+	{
+		int pin[MAX_PINS+1] = { 0 };
+		int prev_pin[MAX_PINS+1] = { 0 };
+        int event_pin[MAX_PINS+1] = { 0 };
+		int x = i;
+
+		for(int j = 0; j < num_input_pins; j++)
+		{
+			pin[desc->input_pins[j]] = x & 1;
+			x >>= 1;
+		}
+		
+		for(int j = 0; desc->event_pins[j]; j++)
+		{
+			event_pin[desc->event_pins[j]] = x & 1;
+			x >>= 1;
+		}
+
+		if(desc->prev_output_pin)
+			prev_pin[desc->prev_output_pin] = x & 1;
+
+		desc->logic_func(pin, prev_pin, event_pin, custom_data);
+		
+		if(lut == NULL)
+			entry.lut_data |= ((pin[desc->output_pin] ? 1ull : 0) << i);
+		else
+            lut[i >> 5] |= ((pin[desc->output_pin] ? 1 : 0) << (i & 0x1f));
 	}
+
+    entry.lut = lut;
+    pool.entries[std::make_pair(desc, key)] = entry;
+    return entry;
 }
 
-Chip::Chip(int QUEUE_SIZE, int SUBCYCLE_SIZE, Circuit* cir, const ChipDesc* desc, void* custom) : Cycle(QUEUE_SIZE, SUBCYCLE_SIZE),
-	circuit(cir), custom_data(custom), inputs(0), output(0), event_mask(~0), prev_output_mask(0), /*deactive_inputs(0),*/ optimization_disabled(false),
-    pending_event(0), state(PASSIVE), /*input_event_type(0),*/ sleep_time(0), current_cycle(this), last_output_event(0), visited(false), 
-    total_event_count(0), activation_count(0), loop_count{{0}}, analog_output(0.0),
+void LutPool::insert(const ChipDesc* desc, const void* key, const Entry& entry, int lut_size)
+{
+    LutPoolState& pool = lut_pool();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+
+    if(pool.entries.insert(std::make_pair(std::make_pair(desc, key), entry)).second && lut_size > 6)
+        pool.bytes += sizeof(uint32_t)*(1 << (lut_size-5));
+}
+
+int LutPool::lutSize(const ChipDesc* desc)
+{
+    if(desc->custom_logic || desc->logic_func == NULL) return 0;
+
+    int lut_size = 0;
+    for(int i = 0; desc->input_pins[i]; i++) lut_size++;
+    for(int i = 0; desc->event_pins[i]; i++) lut_size++;
+    if(desc->prev_output_pin) lut_size++;
+
+    return lut_size;
+}
+
+size_t LutPool::tableCount()
+{
+    LutPoolState& pool = lut_pool();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    return pool.entries.size();
+}
+
+size_t LutPool::tableBytes()
+{
+    LutPoolState& pool = lut_pool();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    return pool.bytes;
+}
+
+Chip::Chip(int QUEUE_SIZE, int SUBCYCLE_SIZE, Circuit* cir, const ChipDesc* desc, void* custom, const void* lut_key) : ChipHotState(cir), Cycle(QUEUE_SIZE, SUBCYCLE_SIZE),
+	fanout(NULL), output_count(0), index(0), custom_data(custom), /*deactive_inputs(0),*/
+    /*input_event_type(0),*/ sleep_time(0), current_cycle(this), last_output_event(0), visited(false), 
+    optimizer_cost(0), optimizer_saving(0), active_since(0), review_time(0), reoptimize_countdown(0), optimizer_strikes(0), deoptimizations(0),
+    loop_count{{0}}, analog_output(0.0),
     input_events(QUEUE_SIZE), input_event_end_time(QUEUE_SIZE), first_input_event(QUEUE_SIZE), first_input_table_pos(QUEUE_SIZE),
     sub_cycles(SUBCYCLE_SIZE, nullptr)
 {
@@ -101,52 +233,18 @@ Chip::Chip(int QUEUE_SIZE, int SUBCYCLE_SIZE, Circuit* cir, const ChipDesc* desc
         lut_size++;
 	}
 
+    //input_event_table.resize(1 << lut_size);
+
+    LutPool::Entry entry = LutPool::get(desc, lut_key, custom_data, lut_size);
 	if(lut_size <= 6)
 	{
 		type = SIMPLE_CHIP;
-		lut_data = 0;
-        //type = BASIC_CHIP;
-		//lut = new uint32_t[2];
-        //lut[0] = lut[1] = 0;
+		lut_data = entry.lut_data;
 	}
 	else
 	{
 		type = BASIC_CHIP;
-		lut = new uint32_t[1 << (lut_size-5)];
-		memset(lut, 0, sizeof(uint32_t)*(1 << (lut_size-5)));
-	}
-
-    //input_event_table.resize(1 << lut_size);
-
-	// Fill the LUT
-	for(int i = 0; i < (1 << lut_size); i++)
-	{
-		int pin[MAX_PINS+1] = { 0 };
-		int prev_pin[MAX_PINS+1] = { 0 };
-        int event_pin[MAX_PINS+1] = { 0 };
-		int x = i;
-
-		for(int j = 0; j < num_input_pins; j++)
-		{
-			pin[desc->input_pins[j]] = x & 1;
-			x >>= 1;
-		}
-		
-		for(int j = 0; desc->event_pins[j]; j++)
-		{
-			event_pin[desc->event_pins[j]] = x & 1;
-			x >>= 1;
-		}
-
-		if(desc->prev_output_pin)
-			prev_pin[desc->prev_output_pin] = x & 1;
-
-		desc->logic_func(pin, prev_pin, event_pin, custom_data);
-		
-		if(type == SIMPLE_CHIP)
-			lut_data |= ((pin[desc->output_pin] ? 1ull : 0) << i);
-		else
-            lut[i >> 5] |= ((pin[desc->output_pin] ? 1 : 0) << (i & 0x1f));
+		lut = entry.lut;
 	}
 
 
@@ -214,44 +312,66 @@ Chip::Chip(int QUEUE_SIZE, int SUBCYCLE_SIZE, Circuit* cir, const ChipDesc* desc
     }*/
 }
 
-extern CUSTOM_LOGIC( deoptimize );
-
-void Chip::connect(Chip* chip, const ChipDesc* desc, uint8_t pin)
+// Runtime state is copied, the LUT and fan-out row are shared with parent
+Chip::Chip(const Chip& parent, Circuit* cir) : ChipHotState(parent), Cycle(parent),
+    fanout(parent.fanout), output_count(parent.output_count), index(parent.index), input_links(parent.input_links),
+    custom_data(parent.custom_data), input_events(parent.input_events), input_event_end_time(parent.input_event_end_time),
+    first_input_table_pos(parent.first_input_table_pos), first_input_event(parent.first_input_event),
+    first_input_mask(parent.first_input_mask), active_inputs(parent.active_inputs), sleep_time(parent.sleep_time),
+    sub_cycles(parent.sub_cycles), activation_cycles(parent.activation_cycles), last_input_event(parent.last_input_event),
+    last_output_event(parent.last_output_event), visited(parent.visited), optimizer_cost(parent.optimizer_cost),
+    optimizer_saving(parent.optimizer_saving), active_since(parent.active_since), review_time(parent.review_time),
+    reoptimize_countdown(parent.reoptimize_countdown), optimizer_strikes(parent.optimizer_strikes),
+    deoptimizations(parent.deoptimizations), analog_output(parent.analog_output)
 {
-    //this is output, chip is input
+    circuit = cir;
 
-    for(int i = 0; desc->input_pins[i]; i++)
-        if(desc->input_pins[i] == pin)
-        {
-			// If output links already contains a link to this chip,
-            // OR with its mask, otherwise add new link
-            int x;
-            for(x = 0; x < output_links.size(); x++)
-                if(output_links[x].chip == chip) break;
+    // Most tables are never used, copy live slots only (as saveState() does)
+    input_event_table.reserve(parent.input_event_table.size());
+    for(const cirque<uint16_t>& t : parent.input_event_table)
+    {
+        input_event_table.emplace_back(first_output_event.getQueueSize());
+        input_event_table.back().copy_live(t);
+    }
 
-            if(x != output_links.size())
-            {
-                output_links[x].mask |= (1 << i);
-            }
-            else
-            {
-                output_links.push_back(ChipLink(chip, 1 << i));
-                active_outputs |= (1ull << x);
-            }
+    for(Cycle*& c : sub_cycles)
+        if(c != NULL) c = new Cycle(*c);
 
-            // Add event bit to mask if this is an event pin
-            for(int j = 0; desc->event_pins[j]; j++)
-                if(desc->event_pins[j] == pin)
-                    output_links[x].mask |= (1 << (chip->input_links.size() + j));
+    fork_cycle(parent, *this);
+    for(Cycle* c : sub_cycles)
+        if(c != NULL) fork_cycle(parent, *c);
 
-            // Don't connect deoptimizer to input
-            if(type != CUSTOM_CHIP || custom_update != deoptimize)
-                chip->input_links[i] = ChipLink(this, 1ull << x);
+    current_cycle = cycle_at(parent.cycle_id(parent.current_cycle));
+}
 
-            return;
-        }
+void Chip::fork_cycle(const Chip& parent, Cycle& c)
+{
+    c.parent_cycle = cycle_at(parent.cycle_id(c.parent_cycle));
+
+    // Stale slots too, the chip logic can still read them
+    c.output_events.for_each_slot([&](Event& e)
+    {
+        if(e.type) e.sub_cycle = cycle_at(parent.cycle_id(e.sub_cycle));
+    });
 }
 
+// Same positions in circuit->chips as parent's links
+void Chip::fork_links(const Chip& parent)
+{
+    const std::vector<Chip*>& chips = circuit->chips;
+
+    for(int i = 0; i < input_links.size(); i++)
+    {
+        if(input_links[i].chip == NULL) continue;
+
+        const Chip* in = parent.input_links[i].chip;
+        input_links[i].chip = chips[in->index];
+        activation_cycles[i] = input_links[i].chip->cycle_at(in->cycle_id(parent.activation_cycles[i]));
+    }
+}
+
+extern CUSTOM_LOGIC( deoptimize );
+
 int Chip::get_next_output(uint64_t time)
 {
 #ifdef DEBUG
@@ -294,9 +414,14 @@ void Chip::wake_up()
     debug_printf("waking up %p\n", this);
 
     state = ACTIVE;
+    PROFILE_COUNT(circuit, this, wakes);
+
+    // Output catches up here, outside of this chip's own events
+    if(circuit->recorder) circuit->touched_chips.push_back(index);
 
     // Get chip up to date
     const uint64_t global_time = circuit->global_time;
+    credit_sleep();
     uint64_t time = (global_time - sleep_time) % cycle_time;
     uint64_t delay = current_cycle->next_output_event_delay();
     last_output_event = global_time - time; // TODO: Is this correct?
@@ -346,7 +471,7 @@ void Chip::wake_up()
     for(uint64_t m = ~act_out & current_cycle->active_outputs; m;)
     {
         int i = Chip::next_bit64(m);
-        output_links[i].chip->deactivate_outputs();
+        output_chip(i)->deactivate_outputs();
         m &= ~(1ull << i);
     }
 }
@@ -357,7 +482,7 @@ void Chip::wake_up()
 #if 1
 void Chip::update_inputs(uint32_t mask)
 {
-    total_event_count++;
+    PROFILE_COUNT(circuit, this, events);
     
     const uint64_t global_time = circuit->global_time;
 
@@ -371,6 +496,7 @@ void Chip::update_inputs(uint32_t mask)
     else if(optimization_disabled)
     {
         update_inputs_simple(this, mask);
+        if(reoptimize_countdown && --reoptimize_countdown == 0) enable_optimization();
         return;
     }
 
@@ -474,12 +600,14 @@ void Chip::update_inputs(uint32_t mask)
 
         if(output_events.full())
         {
+            PROFILE_COUNT(circuit, this, queue_overflows);
             if(output_events.front().type)
                 allocated_sub_cycles.deallocate(output_events.front().sub_cycle->allocated_sub_cycles);
                 //allocated_sub_cycles &= ~output_events.front().sub_cycle->allocated_sub_cycles;
         }
 
         output_events.push_back(Event(global_time + delay[output], new_out));
+        PROFILE_PEAK(circuit, this, queue_peak, output_events.size());
 
         debug_printf("new_event: t:%lld %x %lld\n", global_time, this, output_events.back().time);
     }
@@ -526,6 +654,7 @@ void Chip::update_inputs(uint32_t mask)
     first_input_mask = active_inputs = (1 << input_links.size()) - 1;
 
     // TODO: use empty check? sort of not needed
+    if(!input_events.empty()) PROFILE_COUNT(circuit, this, activation_checks);
     if(!input_events.empty() && activation_check(input_events.front().time, global_time) < global_time)
     {
         activate_inputs();
@@ -539,11 +668,19 @@ void Chip::update_inputs(uint32_t mask)
     }
     else
     if(input_events.full())
+    {
+        PROFILE_COUNT(circuit, this, queue_overflows);
         input_event_table[input_events.front().state].pop_front();
+    }
 
     //input_event_type &= ~(1ull << input_events.end());
     input_event_table[inputs].push_back(input_events.end().getRawIndex());
     input_events.push_back(Event(global_time, inputs));
+    PROFILE_PEAK(circuit, this, queue_peak, input_events.size());
+
+    if(optimizer_cost >= OPTIMIZER_REVIEW_STEPS && global_time - review_time >= OPTIMIZER_REVIEW_TIME &&
+       circuit->settings.adaptive_optimization)
+        review_optimization();
     
     /*deactive_inputs = deactivation_table[inputs];
     
@@ -566,7 +703,7 @@ void Chip::update_inputs(uint32_t mask)
 
 void Chip::update_inputs(uint32_t mask)
 {
-    total_event_count++;
+    PROFILE_COUNT(circuit, this, events);
 
     if(type == CUSTOM_CHIP)
 	{
@@ -615,12 +752,17 @@ void Chip::update_inputs_simple(Chip* chip, int mask)
 void Chip::update_output()
 {
     debug_printf("update output: %p t:%lld o:%d\n", this, circuit->global_time, output ^ 1);
-    
+
+    // Not only from this chip's own events, custom chips call it too
+    if(circuit->recorder) circuit->touched_chips.push_back(index);
+
     uint64_t global_time = circuit->global_time;
 
     if(state == ASLEEP)
     {
         state = ACTIVE;
+        PROFILE_COUNT(circuit, this, wakes);
+        credit_sleep();
         
         Cycle* parent = current_cycle->parent_cycle;
         
@@ -665,7 +807,7 @@ void Chip::update_output()
         for(uint64_t m = ~act_out & current_cycle->active_outputs; m;)
         {
             int i = Chip::next_bit64(m);
-            output_links[i].chip->deactivate_outputs();
+            output_chip(i)->deactivate_outputs();
             m &= ~(1ull << i);
         }
 
@@ -676,18 +818,21 @@ void Chip::update_output()
 
     last_output_event = global_time;
 
+    Chip* const* chips = circuit->chips.data();
+
     // Don't just iterate through this the normal way -
     // active_outputs can be modified through update_inputs().
     for(uint64_t mask = ~0ull; current_cycle->active_outputs & mask;)
     {
         int i = Chip::next_bit64(current_cycle->active_outputs & mask);
-        ChipLink* link = &output_links[i];
-        link->chip->update_inputs(link->mask);
+        const FanoutLink& link = fanout[i];
+        chips[link.chip]->update_inputs(link.mask);
         mask &= ~(1ull << i);
     }
 
 	output ^= 1;
 	pending_event = 0;
+    PROFILE_COUNT(circuit, this, toggles);
 
     if(state == ACTIVE)
     {
@@ -696,6 +841,7 @@ void Chip::update_output()
             debug_printf("going to sleep:%x\n", this);
             state = ASLEEP;
             sleep_time = global_time;
+            PROFILE_COUNT(circuit, this, sleeps);
 
             //while(current_cycle->parent_cycle && current_cycle->parent_cycle->active_outputs == 0) // TODO: make this work?
             //    current_cycle = current_cycle->parent_cycle;
@@ -722,7 +868,7 @@ void Chip::update_output()
             for(uint64_t m = ~current_cycle->active_outputs & current_cycle->parent_cycle->active_outputs; m;)
             {
                 int i = Chip::next_bit64(m);
-                output_links[i].chip->deactivate_outputs();
+                output_chip(i)->deactivate_outputs();
                 m &= ~(1ull << i);
             }
             
@@ -788,6 +934,7 @@ uint64_t Chip::activation_check(uint64_t min_time, uint64_t max_time)
         //if(curr_loop_count++ >= 64) break;
         
         loop_count[0]++;
+        optimizer_cost++;
 
         //cirque<Event>::index i = input_event_list[x];
         cirque<Event>::index i = x.makeIndex(input_event_list[x]);
@@ -858,6 +1005,7 @@ uint64_t Chip::activation_check(uint64_t min_time, uint64_t max_time)
         for(int j = 0; active_inputs >> j; j++)
         {
             loop_count[2]++;
+            optimizer_cost++;
             
             j += Chip::next_bit(active_inputs >> j);
             Chip* chip = input_links[j].chip;
@@ -1085,7 +1233,7 @@ void Chip::activate_inputs()
 {
     //visited = true;
 
-    activation_count++;
+    PROFILE_COUNT(circuit, this, activations);
 
     debug_printf("activating: %p t:%lld act:%lld\n", this, circuit->global_time, activation_time);
 
@@ -1096,6 +1244,9 @@ void Chip::activate_inputs()
     cycle_time = circuit->global_time - activation_time;
     end_time = ~0ull;
 
+    active_since = circuit->global_time;
+    optimizer_cost += input_links.size();
+
     // Reconnect to deactive inputs
 #if 0
     inputs &= ~deactive_inputs;
@@ -1182,6 +1333,11 @@ void Chip::activate_inputs()
 
 void Chip::deactivate_outputs()
 {
+    // Inputs the cycle kept from sending events, one cycle's worth per cycle_time
+    if(state != PASSIVE && cycle_time && !input_events.empty())
+        optimizer_saving += (circuit->global_time - active_since) / cycle_time * events_since(input_events, first_input_event);
+    optimizer_cost += input_links.size() + output_count;
+
     if(state == ASLEEP)
     {
         wake_up();
@@ -1270,12 +1426,12 @@ void Chip::deactivate_outputs()
     if(type == CUSTOM_CHIP || optimization_disabled || input_events.empty())
     {
         // TODO: use iterator?
-        for(int i = 0; i < output_links.size(); i++)
+        for(int i = 0; i < output_count; i++)
         {
             //if((output_links[i].chip->active_inputs & output_links[i].mask) && output_links[i].chip->event_count)
-            if(!(current_cycle->active_outputs & (1ull << i)) && output_links[i].chip->state != PASSIVE) // output_links[i].chip->state != PASSIVE)
+            if(!(current_cycle->active_outputs & (1ull << i)) && output_chip(i)->state != PASSIVE) // output_links[i].chip->state != PASSIVE)
             //if(output_links[i].chip->state != PASSIVE)
-                output_links[i].chip->deactivate_outputs();
+                output_chip(i)->deactivate_outputs();
         }       
        
         return;
@@ -1323,6 +1479,8 @@ void Chip::deactivate_outputs()
     input_event_table[inputs].push_back(input_events.end().getRawIndex());
     input_events.push_back(Event(circuit->global_time, inputs));
 
+    if(allocated_sub_cycles.full()) PROFILE_COUNT(circuit, this, subcycle_full);
+
     //while(~allocated_sub_cycles == 0)
     while(allocated_sub_cycles.full())
     {
@@ -1440,16 +1598,16 @@ void Chip::deactivate_outputs()
 #endif
 
     // TODO: use iterator?
-    for(int i = 0; i < output_links.size(); i++)
+    for(int i = 0; i < output_count; i++)
     {
         //if((output_links[i].chip->active_inputs & output_links[i].mask) && output_links[i].chip->event_count)
-        if(!(current_cycle->active_outputs & (1ull << i)) && output_links[i].chip->state != PASSIVE) // output_links[i].chip->state != PASSIVE)
+        if(!(current_cycle->active_outputs & (1ull << i)) && output_chip(i)->state != PASSIVE) // output_links[i].chip->state != PASSIVE)
         //if(output_links[i].chip->state != PASSIVE)
-            output_links[i].chip->deactivate_outputs();
+            output_chip(i)->deactivate_outputs();
     }
 
     current_cycle = this;
-    active_outputs = (1ull << output_links.size()) - 1;
+    active_outputs = (1ull << output_count) - 1;
 
     // If there is a pending event, add to output events
     if(pending_event && pending_event != circuit->global_time) // TODO: is skip when pending event == global_time accurate??? 
@@ -1473,6 +1631,72 @@ void Chip::deactivate_outputs()
             last_input_event[i] = input_links[i].chip->last_output_event;
 }
 
+// Output events skipped while ASLEEP. The chips it drives share the credit:
+// it could only sleep with all of them in cycles.
+void Chip::credit_sleep()
+{
+    uint64_t saving = (circuit->global_time - sleep_time) / cycle_time * events_since(output_events, first_output_event);
+
+    optimizer_saving += saving;
+    for(uint32_t i = 0; i < output_count; i++) output_chip(i)->optimizer_saving += saving;
+}
+
+// Adaptive de-optimization: every OPTIMIZER_REVIEW_STEPS steps of looking for,
+// entering and leaving cycles, but no more than once a frame, compare them with
+// the events the cycles saved. A chip that entered a cycle since the last review
+// passes regardless, chips downstream can't enter theirs without it.
+// Called from update_inputs() while PASSIVE, the only state simple mode can
+// take over from without undoing a cycle.
+void Chip::review_optimization()
+{
+    bool pays = active_since > review_time || optimizer_saving * OPTIMIZER_STEPS_PER_EVENT >= optimizer_cost;
+    optimizer_strikes = pays ? 0 : optimizer_strikes + 1;
+
+    if(optimizer_strikes >= OPTIMIZER_STRIKES)
+        disable_optimization();
+
+    optimizer_cost = optimizer_saving = 0;
+    review_time = circuit->global_time;
+}
+
+void Chip::disable_optimization()
+{
+    circuit->optimizer_decisions.push_back({ index, circuit->global_time, true, optimizer_cost, optimizer_saving });
+
+    optimization_disabled = true;
+    optimizer_strikes = 0;
+    deoptimizations++;
+
+    // Try again later, waiting twice as long each time, until giving up
+    reoptimize_countdown = deoptimizations < MAX_DEOPTIMIZATIONS ? REOPTIMIZE_EVENTS << deoptimizations : 0;
+
+    // Simple mode keeps no history, what is there now would be stale by then
+    input_events.clear();
+    for(int i = 0; i < input_event_table.size(); i++) input_event_table[i].rewind();
+
+    active_outputs = current_cycle->active_outputs;
+    current_cycle = this;
+    output_events.clear();
+    first_output_event = current_output_event = output_events.begin();
+    allocated_sub_cycles.clear();
+}
+
+void Chip::enable_optimization()
+{
+    // The history would start without the pending event's output change, wait it out
+    if(pending_event)
+    {
+        reoptimize_countdown = 1;
+        return;
+    }
+
+    circuit->optimizer_decisions.push_back({ index, circuit->global_time, false, 0, 0 });
+
+    optimization_disabled = false;
+    optimizer_cost = optimizer_saving = 0;
+    review_time = circuit->global_time;
+}
+
 
 
 inline int Chip::next_bit(uint32_t x)
@@ -1508,3 +1732,169 @@ inline int Chip::next_bit64(uint64_t x)
 #endif  
 }
 
+
+
+template <typename I> static void serialize_index(nall::serializer& s, I& i)
+{
+    uint16_t raw = i.getRawIndex();
+    s.integer(raw);
+    i = i.makeIndex(raw);
+}
+
+uint32_t Chip::cycle_id(const Cycle* c) const
+{
+    if(c == NULL) return 0;
+    if(c == this) return 1;
+
+    for(int i = 0; i < sub_cycles.size(); i++)
+        if(sub_cycles[i] == c) return i + 2;
+
+    return 0;
+}
+
+// Cycle pointers are saved relative to the chip owning the cycle
+void Chip::serialize_cycle_ptr(nall::serializer& s, Cycle*& c)
+{
+    uint32_t id = cycle_id(c);
+    s.integer(id);
+
+    if(s.mode() == nall::serializer::Load)
+        c = cycle_at(id);
+}
+
+// Sub-cycles no longer allocated only keep what stale pointers to them can
+// reach, their events are rewritten before they are used again
+void Chip::serialize_cycle(nall::serializer& s, Cycle& c, bool live)
+{
+    serialize_cycle_ptr(s, c.parent_cycle);
+    s.array(c.allocated_sub_cycles.bits, c.allocated_sub_cycles.N);
+
+    if(live) c.output_events.serialize(s, [&](Event& e)
+    {
+        s.integer(e.time);
+        s.integer(e.type);
+        if(e.type) serialize_cycle_ptr(s, e.sub_cycle);
+        else s.integer(e.state);
+    });
+    serialize_index(s, c.first_output_event);
+    serialize_index(s, c.current_output_event);
+
+    s.integer(c.activation_time);
+    s.integer(c.cycle_time);
+    s.integer(c.cycle_duration);
+    s.integer(c.end_time);
+    s.integer(c.active_outputs);
+}
+
+void Chip::serialize(nall::serializer& s)
+{
+    const bool load = s.mode() == nall::serializer::Load;
+
+    // Custom chips may switch their update function (e.g. after init). It is saved
+    // relative to deoptimize(), so it loads in another process of the same executable.
+    if(type == CUSTOM_CHIP)
+    {
+        uint64_t update = lut_data - uint64_t(&deoptimize);
+        s.integer(update);
+        lut_data = update + uint64_t(&deoptimize);
+    }
+
+    s.integer(pending_event);
+    s.array(delay);
+    s.integer(inputs);
+    s.integer(output);
+
+    uint8_t st = state;
+    s.integer(st);
+    state = ChipState(st);
+    s.integer(optimization_disabled);
+
+    // Sub-cycles are allocated on first use, match the saved set before
+    // any pointers into them are restored
+    for(int i = 0; i < sub_cycles.size(); i++)
+    {
+        bool present = sub_cycles[i] != NULL;
+        s.integer(present);
+
+        if(load && present && sub_cycles[i] == NULL)
+            sub_cycles[i] = new Cycle(first_output_event.getQueueSize(), allocated_sub_cycles.size());
+        else if(load && !present && sub_cycles[i] != NULL)
+        {
+            delete sub_cycles[i];
+            sub_cycles[i] = NULL;
+        }
+    }
+
+    serialize_cycle(s, *this, true);
+    for(int i = 0; i < sub_cycles.size(); i++)
+        if(sub_cycles[i] != NULL)
+            serialize_cycle(s, *sub_cycles[i], (allocated_sub_cycles.bits[i >> 6] >> (i & 63)) & 1);
+
+    input_events.serialize(s, [&s](Event& e)
+    {
+        s.integer(e.time);
+        s.integer(e.state);
+        s.integer(e.type);
+    });
+
+    // Indexed like input_events, only its live slots are used
+    for(cirque<Event>::index i = input_events.begin(); i != input_events.end(); ++i)
+        s.integer(input_event_end_time[i]);
+
+    // One table per input state seen, most of them unused
+    uint32_t tables = input_event_table.size(), used = 0;
+    for(const cirque<uint16_t>& t : input_event_table)
+        if(t.begin().getRawIndex() || t.end().getRawIndex()) used++;
+
+    s.integer(tables);
+    s.integer(used);
+    if(load)
+    {
+        input_event_table.resize(tables, cirque<uint16_t>(first_output_event.getQueueSize()));
+        for(cirque<uint16_t>& t : input_event_table) t.rewind();
+
+        for(uint32_t i = 0; i < used; i++)
+        {
+            uint32_t n;
+            s.integer(n);
+            input_event_table[n].serialize(s);
+        }
+    }
+    else for(uint32_t n = 0; n < tables; n++)
+    {
+        cirque<uint16_t>& t = input_event_table[n];
+        if(t.begin().getRawIndex() || t.end().getRawIndex())
+        {
+            s.integer(n);
+            t.serialize(s);
+        }
+    }
+
+    serialize_index(s, first_input_table_pos);
+    serialize_index(s, first_input_event);
+    s.integer(first_input_mask);
+    s.integer(active_inputs);
+    s.integer(sleep_time);
+
+    serialize_cycle_ptr(s, current_cycle);
+
+    s.array(last_input_event.data(), last_input_event.size());
+    s.integer(last_output_event);
+    s.integer(visited);
+    s.integer(optimizer_cost);
+    s.integer(optimizer_saving);
+    s.integer(active_since);
+    s.integer(review_time);
+    s.integer(reoptimize_countdown);
+    s.integer(optimizer_strikes);
+    s.integer(deoptimizations);
+    s(analog_output);
+}
+
+// Points into the input chips' cycles, so run after all chips are restored
+void Chip::serialize_activation_cycles(nall::serializer& s)
+{
+    for(int i = 0; i < activation_cycles.size(); i++)
+        if(input_links[i].chip)
+            input_links[i].chip->serialize_cycle_ptr(s, activation_cycles[i]);
+}
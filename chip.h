@@ -2,6 +2,7 @@
 #define CHIP_H
 
 #include <cstddef>
+#include <cstdlib>
 #include <stdint.h>
 #include <vector>
 #include <array>
@@ -13,10 +14,11 @@
 class Circuit;
 class ChipDesc;
 class Chip;
+namespace nall { struct serializer; }
 
-enum ChipType { SIMPLE_CHIP = 0, BASIC_CHIP, CUSTOM_CHIP };
+enum ChipType : uint8_t { SIMPLE_CHIP = 0, BASIC_CHIP, CUSTOM_CHIP };
 
-enum ChipState { ACTIVE = 0, PASSIVE, ASLEEP };
+enum ChipState : uint8_t { ACTIVE = 0, PASSIVE, ASLEEP };
 
 struct ChipLink
 {
@@ -26,6 +28,15 @@ struct ChipLink
     ChipLink(Chip* c = NULL, uint64_t m = 0) : chip(c), mask(m) {}
 };
 
+// Output link, in Circuit::fanout once the netlist is built
+struct FanoutLink
+{
+    uint32_t chip; // Index into Circuit::chips
+    uint32_t mask;
+
+    FanoutLink(uint32_t c = 0, uint32_t m = 0) : chip(c), mask(m) {}
+};
+
 struct Cycle;
 
 struct Event
@@ -114,6 +125,11 @@ struct SubcycleAllocator
         bits = new uint64_t[N]; 
         memset(bits, 0, sizeof(uint64_t)*N);
     }
+    SubcycleAllocator(const SubcycleAllocator& a) : N(a.N)
+    {
+        bits = new uint64_t[N];
+        memcpy(bits, a.bits, sizeof(uint64_t)*N);
+    }
     ~SubcycleAllocator() { delete[] bits; }
 
     int size() const { return N << 6; }
@@ -297,38 +313,79 @@ class CustomChip : public Chip
 
 */
 
-class Chip : public Cycle
+// State read by update_inputs()/update_inputs_simple() on every event.
+// It is the first base of Chip and fits one cache line, so with chips
+// allocated on cache line boundaries each fan-out target touches one line.
+struct ChipHotState
 {
-public:
     Circuit* circuit;
-	
+
+	union {
+		uint64_t lut_data;
+		const uint32_t* lut; // Shared through LutPool
+        void (*custom_update)(Chip* chip, int mask);
+	};
+
+  	uint64_t pending_event;
+	uint64_t delay[2];
+
     int inputs;
     int output;
 
 	int event_mask;
 	int prev_output_mask;
 
-	uint64_t delay[2];
+	ChipType type;
+    ChipState state;
+    bool optimization_disabled;
 
-  	uint64_t pending_event;
+    ChipHotState(Circuit* cir) : circuit(cir), lut_data(0), pending_event(0), delay{0, 0},
+        inputs(0), output(0), event_mask(~0), prev_output_mask(0), type(SIMPLE_CHIP),
+        state(PASSIVE), optimization_disabled(false) { }
+};
 
-    std::vector<ChipLink> output_links;
-    std::vector<ChipLink> input_links;
+static const size_t CACHE_LINE_SIZE = 64;
+static_assert(sizeof(ChipHotState) <= CACHE_LINE_SIZE, "Chip hot state must fit a cache line");
 
-	ChipType type;
-	
-	union {
-		uint64_t lut_data;
-		uint32_t* lut;
-        void (*custom_update)(Chip* chip, int mask);
-	};
+// Process-wide store of chip LUTs. A LUT only depends on the ChipDesc and what
+// its logic function reads from custom_data (ROM images, diode layouts), so
+// chips built from the same pair share one, within a circuit and across all
+// circuits in the process. Tables are never changed or freed once built.
+class LutPool
+{
+public:
+    struct Entry
+    {
+        uint64_t lut_data;   // SIMPLE_CHIP, up to 6 inputs
+        const uint32_t* lut; // BASIC_CHIP
+    };
+
+    // LUT of desc with lut_size inputs (pins, then event pins, then the previous output),
+    // built with custom_data the first time key is seen with desc
+    static Entry get(const ChipDesc* desc, const void* key, void* custom_data, int lut_size);
+
+    // Adds a LUT built elsewhere (NetlistImage), table must stay valid for the life of
+    // the process. Ignored if desc and key already have one.
+    static void insert(const ChipDesc* desc, const void* key, const Entry& entry, int lut_size);
+
+    // Number of LUT inputs of desc, 0 for custom chips
+    static int lutSize(const ChipDesc* desc);
+
+    static size_t tableCount(); // LUTs built so far
+    static size_t tableBytes(); // Memory held by BASIC_CHIP tables
+};
+
+class Chip : public ChipHotState, public Cycle
+{
+public:
+    const FanoutLink* fanout; // This chip's row of Circuit::fanout, bit i of active_outputs is entry i
+    uint32_t output_count;    // Entries in the row
+    uint32_t index;           // Position in Circuit::chips, set with fanout
+    std::vector<ChipLink> input_links;
 
     void* custom_data;
-    bool optimization_disabled;
 	
     // Begin new stuff
-    ChipState state;
-
     cirque<Event> input_events;
     cirque<uint64_t> input_event_end_time;
     //cirque<uint64_t> next_check_time; 
@@ -363,10 +420,26 @@ public:
 
     bool visited;
     // End new stuff
+
+    // Cost of the cycle optimizer against what it saves, for adaptive de-optimization
+    // (Settings::adaptive_optimization), see review_optimization()
+    uint64_t optimizer_cost;       // Loop steps spent finding, entering and leaving cycles since the last review
+    uint64_t optimizer_saving;     // Events the cycles made unnecessary since the last review
+    uint64_t active_since;         // When the current cycle was entered
+    uint64_t review_time;          // When the optimizer was last reviewed (or enabled again)
+    uint32_t reoptimize_countdown; // Events left until the optimizer is tried again after disabling it, 0 = never
+    uint8_t  optimizer_strikes;    // Reviews in a row where the optimizer cost more than it saved
+    uint8_t  deoptimizations;      // Times it was disabled at run time
 	
-	Chip(int QUEUE_SIZE, int SUBCYCLE_SIZE, Circuit* cir, const ChipDesc* desc, void* custom = NULL);
-    void connect(Chip* chip, const ChipDesc* desc, uint8_t pin);
-	void initialize();
+	// lut_key stands for what the LUT logic reads from custom (the descriptor it was
+	// copied from, when copied), chips with the same desc and lut_key share a LUT
+	Chip(int QUEUE_SIZE, int SUBCYCLE_SIZE, Circuit* cir, const ChipDesc* desc, void* custom = NULL, const void* lut_key = NULL);
+    Chip(const Chip& parent, Circuit* cir); // For Circuit::fork(), call fork_links() once all chips exist
+
+    // Cache line aligned, see ChipHotState
+    static void* operator new(size_t size);
+    static void operator delete(void* p) { free(p); }
+	bool initialize(); // Power-on evaluation, true if the output changed (fan-out inputs are updated, see Circuit::settle())
 
     void update_inputs(uint32_t mask);
 	void update_output();
@@ -380,21 +453,37 @@ public:
     void wake_up();
     int get_next_output(uint64_t time);
 
+    void credit_sleep();
+    void review_optimization();
+    void disable_optimization();
+    void enable_optimization();
+
     static int next_bit(uint32_t x);
     static int next_bit64(uint64_t x);
 
     static void update_inputs_simple(Chip* chip, int mask);
 
+    // Save or restore everything that changes while running (see Circuit::saveState)
+    void serialize(nall::serializer& s);
+    void serialize_activation_cycles(nall::serializer& s);
+    void serialize_cycle(nall::serializer& s, Cycle& c, bool live);
+    void serialize_cycle_ptr(nall::serializer& s, Cycle*& c);
+    uint32_t cycle_id(const Cycle* c) const; // 0 = none, 1 = this chip, n + 2 = sub_cycles[n]
+    Cycle* cycle_at(uint32_t id) { return (id == 0) ? NULL : (id == 1) ? this : sub_cycles[id - 2]; }
+
+    // Point a forked chip's links and cycles at its own circuit instead of parent's
+    void fork_cycle(const Chip& parent, Cycle& c);
+    void fork_links(const Chip& parent);
+
     double analog_output;
 
     //For debugging
-    debug_var total_event_count;
-    debug_var activation_count;
     debug_var loop_count[8];
     debug_var max_cycle_length;
     debug_var max_subcycle_length;
     
     double analog_input(int n) { return input_links[n].chip->analog_output; }
+    Chip* output_chip(int n) const; // Chip driven by fanout entry n, see circuit.h
 
     void print_input_events()
     {
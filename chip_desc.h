@@ -90,4 +90,15 @@ struct ChipDesc
 
 #define CHIP_ALIAS( name, desc ) constexpr ChipDesc* chip_##name = chip_##desc
 
+// Handed to the relink() of a custom_data descriptor that points at other
+// descriptors (a paddle at its 555), once they have all been copied for a
+// Circuit. links(p) points p at the copy it should use, see CustomDataCopier.
+class CustomDataLinks
+{
+public:
+    virtual void* find(const void* p) const = 0;
+
+    template<typename T> void operator()(T*& p) const { p = (T*)find(p); }
+};
+
 #endif
@@ -0,0 +1,136 @@
+#include "chip_profiler.h"
+#include "circuit.h"
+#include "hint_table.h"
+
+#include <algorithm>
+#include <map>
+
+// Bounds of tuned sizes. Below MIN_TUNED_QUEUE a queue saves next to nothing.
+static const int MIN_TUNED_QUEUE = 16;
+static const int MAX_TUNED_QUEUE = 4096;
+static const int MAX_TUNED_SUBCYCLES = 1024;
+
+void ChipProfiler::report(FILE* f, const Circuit& circuit, const char* game, unsigned count) const
+{
+    const std::vector<std::string>& names = circuit.tables->chip_names;
+
+    uint64_t total = 0;
+    std::vector<uint32_t> ranked;
+    for(uint32_t i = 0; i < counters.size(); i++)
+    {
+        total += counters[i].events;
+        if(counters[i].events || counters[i].pushes) ranked.push_back(i);
+    }
+
+    // Most events first, ties by index so reports compare line by line
+    std::sort(ranked.begin(), ranked.end(), [&](uint32_t a, uint32_t b)
+    {
+        return counters[a].events != counters[b].events ? counters[a].events > counters[b].events : a < b;
+    });
+
+    fprintf(f, "Chip profile of %s: %llu events in %u chips, %u chips active\n", game,
+            (unsigned long long)total, unsigned(counters.size()), unsigned(ranked.size()));
+    fprintf(f, "%-20s %7s %12s %12s %12s %10s %10s %8s %8s %8s\n", "chip", "share", "events", "toggles",
+            "pushes", "stale pops", "act checks", "act", "sleeps", "wakes");
+
+    for(size_t r = 0; r < ranked.size() && r < count; r++)
+    {
+        uint32_t i = ranked[r];
+        const Counters& c = counters[i];
+        const char* name = i < names.size() ? names[i].c_str() : "?";
+
+        fprintf(f, "%-20s %6.2f%% %12llu %12llu %12llu %10llu %10llu %8llu %8llu %8llu\n", name,
+                total ? c.events * 100.0 / total : 0.0, (unsigned long long)c.events, (unsigned long long)c.toggles,
+                (unsigned long long)c.pushes, (unsigned long long)c.stale_pops, (unsigned long long)c.activation_checks,
+                (unsigned long long)c.activations, (unsigned long long)c.sleeps, (unsigned long long)c.wakes);
+    }
+}
+
+uint64_t ChipProfiler::total(uint64_t Counters::* counter) const
+{
+    uint64_t sum = 0;
+    for(const Counters& c : counters)
+        sum += c.*counter;
+
+    return sum;
+}
+
+ChipProfiler::InstanceMap ChipProfiler::instances(const Circuit& circuit) const
+{
+    // Sub-chips of an instance share its hint
+    InstanceMap instances;
+    for(uint32_t i = 0; i < counters.size() && i < circuit.chips.size(); i++)
+    {
+        if(!circuit.tables->chip_hinted[i]) continue;
+
+        const std::string& name = circuit.tables->chip_names[i];
+        const Chip* chip = circuit.chips[i];
+        const Counters& c = counters[i];
+
+        Instance& in = instances[name.substr(0, name.rfind('.'))];
+        in.queue_size = chip->first_output_event.getQueueSize();
+        in.subcycle_size = chip->allocated_sub_cycles.size();
+        in.overflows += c.queue_overflows;
+        in.peak = std::max(in.peak, c.queue_peak);
+        in.activations += c.activations;
+        in.failed_checks += c.activation_checks - c.activations;
+        in.subcycle_full += c.subcycle_full;
+        in.custom |= chip->type == CUSTOM_CHIP;
+    }
+
+    return instances;
+}
+
+// More by at least a tenth
+static bool improved(uint64_t trial, uint64_t measured)
+{
+    return trial * 10 > measured * 11;
+}
+
+bool ChipProfiler::tuneHints(const InstanceMap& measured, const InstanceMap* trial, HintTable& hints)
+{
+    bool changed = false;
+    for(const auto& entry : measured)
+    {
+        const Instance& in = entry.second;
+        if(in.custom) continue; // Custom logic keeps its own queues
+
+        HintTable::Hint h = { in.queue_size, in.subcycle_size };
+
+        if(trial == nullptr)
+        {
+            // A queue that overflowed dropped events a cycle could have been found in.
+            // One that never did only needs to hold its peak: full() is size() == size - 1.
+            if(in.overflows && in.failed_checks)
+                h.queue_size = std::min(in.queue_size * 4, MAX_TUNED_QUEUE);
+            else if(!in.overflows)
+            {
+                h.queue_size = std::min(MIN_TUNED_QUEUE, in.queue_size);
+                while(h.queue_size < in.peak + 2 && h.queue_size < in.queue_size) h.queue_size *= 2;
+            }
+
+            if(in.subcycle_full)
+                h.subcycle_size = std::min(in.subcycle_size * 2, MAX_TUNED_SUBCYCLES);
+        }
+        else if(trial->count(entry.first))
+        {
+            const Instance& t = trial->at(entry.first);
+            bool found_more = improved(t.activations, in.activations);
+
+            if((t.queue_size > in.queue_size && found_more) || (t.queue_size < in.queue_size && !t.overflows))
+                h.queue_size = t.queue_size;
+
+            if(t.subcycle_size > in.subcycle_size && found_more)
+                h.subcycle_size = t.subcycle_size;
+        }
+
+        const HintTable::Hint* old = hints.find(entry.first);
+        if(!old || old->queue_size != h.queue_size || old->subcycle_size != h.subcycle_size)
+        {
+            hints.hints[entry.first] = h;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
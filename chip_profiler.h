@@ -0,0 +1,91 @@
+#ifndef CHIP_PROFILER_H
+#define CHIP_PROFILER_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+class Circuit;
+class HintTable;
+
+// Event counters for each chip of a circuit, to find the parts of a board worth
+// optimizing. Counting starts with Circuit::setProfiling(true), until then the
+// event loop only tests Circuit::profile for NULL. Building with
+// -DDICE_NO_PROFILING removes the counting altogether.
+class ChipProfiler
+{
+public:
+    struct Counters
+    {
+        uint64_t events;            // Input changes received (Chip::update_inputs)
+        uint64_t toggles;           // Output changes
+        uint64_t pushes;            // Events queued
+        uint64_t stale_pops;        // Events popped after being cancelled or replaced
+        uint64_t activation_checks; // Cycle optimizer looking for a repeating input cycle
+        uint64_t activations;       // ... and finding one
+        uint64_t sleeps;            // Cycle optimizer transitions: outputs no longer watched
+        uint64_t wakes;             // ... and watched again
+        uint64_t queue_overflows;   // Input or output events dropped from a full event queue
+        uint64_t queue_peak;        // Most events held in one of the queues
+        uint64_t subcycle_full;     // Sub-cycles needed while all were allocated
+    };
+
+    explicit ChipProfiler(size_t chip_count) : queue_peak(0), counters(chip_count, Counters()) { }
+
+    uint64_t queue_peak; // Most events in the circuit's queue at once
+
+    Counters* data() { return counters.data(); }
+    void clear() { counters.assign(counters.size(), Counters()); queue_peak = 0; }
+
+    // A counter summed over all chips
+    uint64_t total(uint64_t Counters::* counter) const;
+
+    // Chips ranked by events received, the first count of them, with their
+    // netlist instance names and share of all events
+    void report(FILE* f, const Circuit& circuit, const char* game, unsigned count = 20) const;
+
+    // Counters summed over the sub-chips of each chip instance sized by hints,
+    // with the sizes it was built with
+    struct Instance
+    {
+        int queue_size, subcycle_size;
+        uint64_t overflows, peak, activations, failed_checks, subcycle_full;
+        bool custom;
+    };
+    typedef std::map<std::string, Instance> InstanceMap;
+
+    InstanceMap instances(const Circuit& circuit) const;
+
+    // Sizes to try, from a run with the current ones (measured): a queue that never
+    // filled shrinks to its peak, one that overflowed while cycle searches failed
+    // grows, sub-cycles grow where they ran out. Given the run with those sizes
+    // (trial), keeps the ones that paid off: a larger queue or more sub-cycles if
+    // more cycles were found, a smaller queue if it still didn't overflow.
+    // Sizes go to hints, false if none changed.
+    static bool tuneHints(const InstanceMap& measured, const InstanceMap* trial, HintTable& hints);
+
+private:
+    std::vector<Counters> counters; // By chip index
+};
+
+#ifdef DICE_NO_PROFILING
+#define PROFILE_COUNT(circuit, chip, counter) ((void)0)
+#define PROFILE_PEAK(circuit, chip, counter, value) ((void)0)
+#define PROFILE_PUSH(circuit, chip, queue_size) ((void)0)
+#else
+#define PROFILE_COUNT(circuit, chip, counter) \
+    do { if(ChipProfiler::Counters* profile_ = (circuit)->profile) profile_[(chip)->index].counter++; } while(0)
+#define PROFILE_PEAK(circuit, chip, counter, value) \
+    do { if(ChipProfiler::Counters* profile_ = (circuit)->profile) { \
+        uint64_t value_ = (value); \
+        if(value_ > profile_[(chip)->index].counter) profile_[(chip)->index].counter = value_; } } while(0)
+#define PROFILE_PUSH(circuit, chip, queue_size) \
+    do { if(ChipProfiler::Counters* profile_ = (circuit)->profile) { \
+        profile_[(chip)->index].pushes++; \
+        uint64_t size_ = (queue_size); \
+        if(size_ > (circuit)->profiler->queue_peak) (circuit)->profiler->queue_peak = size_; } } while(0)
+#endif
+
+#endif
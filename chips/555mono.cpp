@@ -23,12 +23,12 @@ CUSTOM_LOGIC( Mono555Desc::mono_555 )
     Mono555Desc* desc = (Mono555Desc*)chip->custom_data;
 
     // Update tp_hl in standard portion based on rc value
-    if(chip->output_links.size())
+    if(chip->output_count)
     {
         if(chip->state != PASSIVE)
             chip->deactivate_outputs(); // TODO: is this necessary?
 
-        chip->output_links[0].chip->delay[0] = uint64_t(LN_3*desc->r*desc->c / Circuit::timescale);
+        chip->output_chip(0)->delay[0] = uint64_t(LN_3*desc->r*desc->c / Circuit::timescale);
 
         // Generate event to standard portion of chip
         chip->pending_event = chip->circuit->queue_push(chip, 0);
@@ -25,9 +25,9 @@ CUSTOM_LOGIC( Mono74121Desc::mono_74121 )
     Mono74121Desc* desc = (Mono74121Desc*)chip->custom_data;
 
     // Update tp_hl in standard portion based on rc value
-    if(chip->output_links.size())
+    if(chip->output_count)
     {
-        chip->output_links[0].chip->delay[1] = uint64_t((LN_2 * (desc->r + K_OHM(2.0)) * desc->c) / Circuit::timescale);
+        chip->output_chip(0)->delay[1] = uint64_t((LN_2 * (desc->r + K_OHM(2.0)) * desc->c) / Circuit::timescale);
     }
 }
 
@@ -41,11 +41,11 @@ CUSTOM_LOGIC( Mono9602Desc::mono_9602A )
     Mono9602Desc* desc = (Mono9602Desc*)chip->custom_data;
 
     // Update tp_hl in standard portion based on rc value
-    if(chip->output_links.size())
+    if(chip->output_count)
     {
-        //chip->output_links[0].chip->delay[1] = uint64_t(TIME_CONSTANT*(desc->r1*desc->c1 + desc->c1) / Circuit::timescale);
+        //chip->output_chip(0)->delay[1] = uint64_t(TIME_CONSTANT*(desc->r1*desc->c1 + desc->c1) / Circuit::timescale);
         // Attempted curve fit - needs to be made more accurate
-        chip->output_links[0].chip->delay[0] = uint64_t((TIME_CONSTANT*(desc->r1*desc->c1 + desc->c1) + 15.0e-12*desc->r1) / Circuit::timescale);
+        chip->output_chip(0)->delay[0] = uint64_t((TIME_CONSTANT*(desc->r1*desc->c1 + desc->c1) + 15.0e-12*desc->r1) / Circuit::timescale);
     }
 }
 
@@ -54,9 +54,9 @@ CUSTOM_LOGIC( Mono9602Desc::mono_9602B )
     Mono9602Desc* desc = (Mono9602Desc*)chip->custom_data;
 
     // Update tp_hl in standard portion based on rc value
-    if(chip->output_links.size())
+    if(chip->output_count)
     {
-        chip->output_links[0].chip->delay[0] = uint64_t((TIME_CONSTANT*(desc->r2*desc->c2 + desc->c2) + 15.0e-12*desc->r2) / Circuit::timescale);
+        chip->output_chip(0)->delay[0] = uint64_t((TIME_CONSTANT*(desc->r2*desc->c2 + desc->c2) + 15.0e-12*desc->r2) / Circuit::timescale);
     }
 }
 
@@ -194,10 +194,10 @@ CUSTOM_LOGIC( Mono74123Desc::mono_74123A )
     Mono74123Desc* desc = (Mono74123Desc*)chip->custom_data;
 
     // Update tp_hl in standard portion based on rc value
-    if(chip->output_links.size())
+    if(chip->output_count)
     {
         // Attempted curve fit - needs to be made more accurate
-        chip->output_links[0].chip->delay[0] = uint64_t((TIME_CONSTANT*desc->r1*desc->c1*(1.0 + 700.0 / desc->r1) + 8.0e-12*desc->r1) / Circuit::timescale);
+        chip->output_chip(0)->delay[0] = uint64_t((TIME_CONSTANT*desc->r1*desc->c1*(1.0 + 700.0 / desc->r1) + 8.0e-12*desc->r1) / Circuit::timescale);
     }
 }
 
@@ -206,9 +206,9 @@ CUSTOM_LOGIC( Mono74123Desc::mono_74123B )
     Mono74123Desc* desc = (Mono74123Desc*)chip->custom_data;
 
     // Update tp_hl in standard portion based on rc value
-    if(chip->output_links.size())
+    if(chip->output_count)
     {
-        chip->output_links[0].chip->delay[0] = uint64_t((TIME_CONSTANT*desc->r2*desc->c2*(1.0 + 700.0 / desc->r2) + 8.0e-12*desc->r2) / Circuit::timescale);
+        chip->output_chip(0)->delay[0] = uint64_t((TIME_CONSTANT*desc->r2*desc->c2*(1.0 + 700.0 / desc->r2) + 8.0e-12*desc->r2) / Circuit::timescale);
     }
 }
 
@@ -1,7 +1,6 @@
 #include "audio.h"
 #include "../circuit.h"
 
-#include <SDL.h>
 #include <algorithm>
 #include <set>
 
@@ -20,6 +19,8 @@ static const double TTL_VOLTAGES[] = { 0.2, 3.4 };
 
 static CUSTOM_LOGIC( audio_timer )
 {
+    if(!chip->circuit->audio.enabled()) return;
+
     chip->state = ACTIVE;
     chip->activation_time = chip->circuit->global_time;
 
@@ -49,9 +50,7 @@ CUSTOM_LOGIC( Audio::audio_output )
     double v = chip->input_links[0].chip->analog_output * volume;
     int16_t sample = (v > INT16_MAX) ? INT16_MAX : (v < INT16_MIN) ? INT16_MIN : v;
 
-    SDL_LockAudio();
-    audio->audio_buffer.push_back(sample);
-    SDL_UnlockAudio();
+    if(!chip->circuit->speculative) audio->output_sample(sample);
 }
 
 CHIP_DESC( AUDIO ) = 
@@ -87,11 +86,12 @@ CUSTOM_LOGIC( Audio::audio )
     {
         //printf("audio init %d\n", chip->output_links.size());
         std::set<Chip*> input_nodes, unqueued_nodes;
-        for(const ChipLink& cl : chip->output_links) 
+        for(uint32_t i = 0; i < chip->output_count; i++) 
         {
-            input_nodes.insert(cl.chip);
-            for(const ChipLink& cl2 : cl.chip->output_links)
-                unqueued_nodes.insert(cl2.chip);
+            Chip* c = chip->output_chip(i);
+            input_nodes.insert(c);
+            for(uint32_t j = 0; j < c->output_count; j++)
+                unqueued_nodes.insert(c->output_chip(j));
         }
         // Add VCC & GND to input_nodes. TODO: Make less ugly
         input_nodes.insert(chip->circuit->chips[0]);
@@ -117,8 +117,8 @@ CUSTOM_LOGIC( Audio::audio )
                 //printf("inserted %p\n", c);
                 audio_nodes.push_back(c);
                 
-                for(const ChipLink& cl : c->output_links)
-                    unqueued_nodes.insert(cl.chip);
+                for(uint32_t i = 0; i < c->output_count; i++)
+                    unqueued_nodes.insert(c->output_chip(i));
                 
                 unqueued_nodes.erase(c);
                 break;
@@ -130,75 +130,28 @@ CUSTOM_LOGIC( Audio::audio )
     for(Chip* c : audio_nodes) c->custom_update(c, 0);
 }
 
-Audio::Audio() : gain(10.0), desc(NULL), settings(NULL), audio_buffer(8192)
+Audio::Audio() : gain(10.0), desc(NULL), settings(NULL), sample_period(1.0 / 48000.0)
+{ }
+
+Audio::~Audio()
 { }
 
 void Audio::audio_init(Circuit* circuit)
 {
     settings = &circuit->settings.audio;
-    
-    //int buffer_size = FREQUENCY[circuit->settings.audio.frequency] / 50; // 20 ms, TODO: Make configurable?
-    // Hardcoded 2048 buffer size now TODO: Make configurable?
-    int buffer_size = 2048;
-
-    SDL_AudioSpec as;
-	as.freq = Settings::Audio::FREQUENCIES[settings->frequency];
-	as.format = AUDIO_S16SYS;
-	as.channels = 1;
-	as.samples = buffer_size;
-	as.callback = &Audio::callback;
-	as.userdata = (void*)this;
-
-    SDL_CloseAudio();
-
-	if(SDL_OpenAudio(&as, NULL) < 0)
-	{
-		printf("Unable to open audio:\n%s\n", SDL_GetError());
-		exit(1);
-	}
 
     if(desc) gain = desc->gain;
-    sample_period = 1.0 / double(as.freq);
-
-    SDL_PauseAudio(settings->mute);
-}
-
-void Audio::toggle_mute()
-{
-    SDL_PauseAudio(settings->mute);
-}
+    sample_period = 1.0 / double(Settings::Audio::FREQUENCIES[settings->frequency]);
 
-Audio::~Audio()
-{
-	SDL_PauseAudio(1); // TODO: move?
-	SDL_CloseAudio();
+    audio_nodes.clear();
 }
 
-void Audio::callback(void* userdata, uint8_t* str, int len)
+// The audio chip only orders its nodes on init, take parent's order for this circuit's chips
+void Audio::audio_fork(Circuit* circuit, const Audio& parent)
 {
-    Audio* audio = (Audio*)userdata;
-    cirque<int16_t>& buffer = audio->audio_buffer;
-   
-    int16_t* stream = (int16_t*)str;
-    int length = len >> 1;
-    
-    static int16_t last_val = 0;
-
-    for(int i = 0; i < length; i++)
-    {
-        if(!buffer.empty())
-        {
-            last_val = stream[i] = buffer.front();
-            buffer.pop_front();
+    desc = parent.desc;
+    audio_init(circuit);
 
-            /*static int max_sample = 0;
-            if(last_val > max_sample) 
-            { printf("Max volume:%d\n", last_val); max_sample = last_val; }*/
-        }
-        else 
-        {
-            stream[i] = last_val;
-        }
-    }
+    for(const Chip* c : parent.audio_nodes)
+        audio_nodes.push_back(circuit->chips[c->index]);
 }
-
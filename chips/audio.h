@@ -14,10 +14,14 @@ public:
     const Settings::Audio* settings;
 
     Audio();
-    ~Audio();
-    void audio_init(Circuit* circuit);
-    void toggle_mute();
-    static void callback(void* userdata, uint8_t* str, int len);
+    virtual ~Audio();
+    virtual void audio_init(Circuit* circuit);
+    void audio_fork(Circuit* circuit, const Audio& parent); // See Circuit::fork()
+    virtual void toggle_mute() { }
+    virtual void output_sample(int16_t sample) = 0;
+
+    // When false the sample clock is never started, so no events are spent on sound
+    virtual bool enabled() const { return true; }
 
     static CUSTOM_LOGIC( audio_input );
     static CUSTOM_LOGIC( audio_output );
@@ -33,8 +37,8 @@ public:
     static double rc_discharge_exponent(double dt, double rc) { return exp(-dt / rc); }
 private:
     std::vector<Chip*> audio_nodes;
-    cirque<int16_t> audio_buffer;
     double gain;
+protected:
     double sample_period;
 };
 
@@ -0,0 +1,16 @@
+#ifndef AUDIO_NULL_H
+#define AUDIO_NULL_H
+
+#include "audio.h"
+
+// Audio back-end without an output device, for running circuits headless
+class AudioNull : public Audio
+{
+public:
+    AudioNull() : Audio() { }
+
+    void output_sample(int16_t sample) { }
+    bool enabled() const { return false; }
+};
+
+#endif
@@ -0,0 +1,82 @@
+#include "audio_sdl.h"
+#include "../circuit.h"
+
+#include <SDL.h>
+
+AudioSdl::AudioSdl() : Audio(), audio_buffer(8192)
+{ }
+
+void AudioSdl::audio_init(Circuit* circuit)
+{
+    Audio::audio_init(circuit);
+
+    //int buffer_size = FREQUENCY[circuit->settings.audio.frequency] / 50; // 20 ms, TODO: Make configurable?
+    // Hardcoded 2048 buffer size now TODO: Make configurable?
+    int buffer_size = 2048;
+
+    SDL_AudioSpec as;
+	as.freq = Settings::Audio::FREQUENCIES[settings->frequency];
+	as.format = AUDIO_S16SYS;
+	as.channels = 1;
+	as.samples = buffer_size;
+	as.callback = &AudioSdl::callback;
+	as.userdata = (void*)this;
+
+    SDL_CloseAudio();
+
+	if(SDL_OpenAudio(&as, NULL) < 0)
+	{
+		printf("Unable to open audio:\n%s\n", SDL_GetError());
+		exit(1);
+	}
+
+    sample_period = 1.0 / double(as.freq);
+
+    SDL_PauseAudio(settings->mute);
+}
+
+void AudioSdl::toggle_mute()
+{
+    SDL_PauseAudio(settings->mute);
+}
+
+AudioSdl::~AudioSdl()
+{
+	SDL_PauseAudio(1); // TODO: move?
+	SDL_CloseAudio();
+}
+
+void AudioSdl::output_sample(int16_t sample)
+{
+    SDL_LockAudio();
+    audio_buffer.push_back(sample);
+    SDL_UnlockAudio();
+}
+
+void AudioSdl::callback(void* userdata, uint8_t* str, int len)
+{
+    AudioSdl* audio = (AudioSdl*)userdata;
+    cirque<int16_t>& buffer = audio->audio_buffer;
+   
+    int16_t* stream = (int16_t*)str;
+    int length = len >> 1;
+    
+    static int16_t last_val = 0;
+
+    for(int i = 0; i < length; i++)
+    {
+        if(!buffer.empty())
+        {
+            last_val = stream[i] = buffer.front();
+            buffer.pop_front();
+
+            /*static int max_sample = 0;
+            if(last_val > max_sample) 
+            { printf("Max volume:%d\n", last_val); max_sample = last_val; }*/
+        }
+        else 
+        {
+            stream[i] = last_val;
+        }
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef AUDIO_SDL_H
+#define AUDIO_SDL_H
+
+#include "audio.h"
+
+class AudioSdl : public Audio
+{
+private:
+    cirque<int16_t> audio_buffer;
+
+public:
+    AudioSdl();
+    ~AudioSdl();
+    void audio_init(Circuit* circuit);
+    void toggle_mute();
+    void output_sample(int16_t sample);
+    static void callback(void* userdata, uint8_t* str, int len);
+};
+
+#endif
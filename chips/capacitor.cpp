@@ -39,9 +39,9 @@ CUSTOM_LOGIC( CapacitorDesc::capacitor )
     CapacitorDesc* desc = (CapacitorDesc*)chip->custom_data;
 
     // Update tp_lh, tp_hl in standard portion based on RC value
-    if(chip->output_links.size())
+    if(chip->output_count)
     {
-        chip->output_links[0].chip->delay[0] = chip->output_links[0].chip->delay[1] =
+        chip->output_chip(0)->delay[0] = chip->output_chip(0)->delay[1] =
             uint64_t(TIME_CONSTANT * (130.0 + desc->r) * desc->c / Circuit::timescale);
     }
 
@@ -100,9 +100,9 @@ CUSTOM_LOGIC( SeriesRCDesc::series_rc )
     SeriesRCDesc* desc = (SeriesRCDesc*)chip->custom_data;
 
     // Update tp_lh, tp_hl in standard portion based on rc value
-    if(chip->output_links.size())
+    if(chip->output_count)
     {
-        chip->output_links[0].chip->delay[1] = uint64_t(desc->r * desc->c / Circuit::timescale);
+        chip->output_chip(0)->delay[1] = uint64_t(desc->r * desc->c / Circuit::timescale);
     }
 }
 
@@ -167,10 +167,10 @@ CUSTOM_LOGIC( BufferDesc::buffer )
     BufferDesc* desc = (BufferDesc*)chip->custom_data;
 
     // Update tp_lh, tp_hl in standard portion based on RC value
-    if(chip->output_links.size())
+    if(chip->output_count)
     {
-        chip->output_links[0].chip->delay[0] = uint64_t(desc->tp_lh / Circuit::timescale);
-        chip->output_links[0].chip->delay[1] = uint64_t(desc->tp_hl / Circuit::timescale);
+        chip->output_chip(0)->delay[0] = uint64_t(desc->tp_lh / Circuit::timescale);
+        chip->output_chip(0)->delay[1] = uint64_t(desc->tp_hl / Circuit::timescale);
     }
 }
 
@@ -35,9 +35,9 @@ static CUSTOM_LOGIC( CLK_GATE )
         chip->inputs ^= mask;
     }
 
-    if(chip->output_links.size()) // Probably can assume this is true
+    if(chip->output_count) // Probably can assume this is true
     {
-        Chip* c = chip->output_links[0].chip;
+        Chip* c = chip->output_chip(0);
         
         if(c->state != PASSIVE)
             c->deactivate_outputs();
@@ -350,9 +350,9 @@ void PotentiometerDesc<T, r>::logic(Chip* chip, int mask)
 
     chip->state = PASSIVE;
 
-    if(desc->current_val != desc->output.*r) // Update resistance value in attached chip
+    if(desc->current_val != desc->output->*r) // Update resistance value in attached chip
     {
-        desc->output.*r = desc->current_val;
+        desc->output->*r = desc->current_val;
         
         chip->deactivate_outputs(); // TODO: is this necessary?
         //chip->state = PASSIVE;
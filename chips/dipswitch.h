@@ -2,6 +2,8 @@
 #define DIPSWITCH_H
 
 #include <array>
+#include <cstring>
+#include <nall/serializer.hpp>
 #include "../chip_desc.h"
 #include "555astable.h"
 #include "555mono.h"
@@ -14,9 +16,12 @@ struct DipswitchBase
 
     constexpr DipswitchBase(const char* n, const char* d, int default_state)
         : name(n), desc(d), state(default_state) { }
+    virtual ~DipswitchBase() { }
 
     virtual const char* const* getSettings() const = 0;
     virtual const size_t settingsSize() const = 0;
+
+    void serialize(nall::serializer& s) { s(state); }
 };
 
 template <size_t N> struct DipswitchTemplate : DipswitchBase
@@ -39,6 +44,7 @@ public:
                             const char* setting1, const char* setting2) 
         : DipswitchTemplate(n, d, default_state, std::array<const char*, 2>{{setting1, setting2}}) { }
     
+    using DipswitchBase::serialize;
     static CUSTOM_LOGIC( logic );
 };
 
@@ -56,6 +62,7 @@ public:
         : DipswitchTemplate(n, d, default_state,
           std::array<const char*, 4>{{setting1, setting2, setting3, setting4}}) { }
 
+    using DipswitchBase::serialize;
     template<int T> static CUSTOM_LOGIC( logic );
 };
 
@@ -84,6 +91,7 @@ public:
            setting9, setting10, setting11, setting12,
            setting13, setting14, setting15, setting16}}) { }
 
+    using DipswitchBase::serialize;
     template<int BIT> static CUSTOM_LOGIC( logic );
 };
 
@@ -114,10 +122,13 @@ template <typename T, double (T::*r)>
 class PotentiometerDesc : PotentiometerBase
 {
 public:
-    T& output;
+    T* output;
 
     PotentiometerDesc(const char* n, const char* d, double default_val, double min, double max, T& t) 
-        : PotentiometerBase(n, d, default_val, min, max), output(t) { }
+        : PotentiometerBase(n, d, default_val, min, max), output(&t) { }
+
+    void serialize(nall::serializer& s) { s(current_val); }
+    void relink(const CustomDataLinks& links) { links(output); }
 
     static CUSTOM_LOGIC( logic );
 };
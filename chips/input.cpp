@@ -2,13 +2,15 @@
 #include "../circuit.h"
 #include "../settings.h"
 
-#include "../manymouse/manymouse.h"
-#include <SDL.h>
-
-using namespace phoenix;
-
 static const double INPUT_POLL_RATE = 10.0e-3; // 10 ms poll rate
 
+// The value read at a poll, or the journaled one when the circuit replays its input
+static double journal_input(Chip* chip, double value)
+{
+    InputJournal* journal = chip->circuit->journal.get();
+    return journal ? journal->poll(chip, value) : value;
+}
+
 extern CUSTOM_LOGIC( clock );
 
 CHIP_DESC( PADDLE1_HORIZONTAL_INPUT ) = 
@@ -281,6 +283,18 @@ void AnalogInputDesc<PADDLE, HORIZONTAL>::analog_input(Chip* chip, int mask)
             desc->current_val = (1.0 - val) * (desc->min_val - desc->max_val) + desc->max_val;
     }
 
+    // Injected position (scripted or agent control) - overrides everything else
+    double pos;
+    if(circuit->input.getPaddlePosition(PADDLE, pos))
+    {
+        if(pos < 0.0) pos = 0.0;
+        else if(pos > 1.0) pos = 1.0;
+
+        desc->current_val = pos * (desc->max_val - desc->min_val) + desc->min_val;
+    }
+
+    desc->current_val = journal_input(chip, desc->current_val);
+
     //if(desc->current_val != prev_val && desc->mono_555) // Update resistance value in 555
     {
         desc->mono_555->r = desc->current_val;
@@ -301,7 +315,7 @@ CUSTOM_LOGIC( digital_input )
     Circuit* circuit = chip->circuit;
     const KeyAssignment& key_assignment = (circuit->settings.*c)().*k;
 
-    int new_out = circuit->input.getKeyPressed(key_assignment);
+    int new_out = journal_input(chip, circuit->input.getKeyPressed(key_assignment)) != 0.0;
     new_out ^= 1; // Joysticks, buttons are active LOW
 
     if(new_out != chip->output)
@@ -636,7 +650,7 @@ void wheel_input(Chip* chip, int mask)
     if(delta > MAX_ANGLE)       delta = MAX_ANGLE;
     else if(delta < -MAX_ANGLE) delta = -MAX_ANGLE;
 
-    delta /= -10.0;
+    delta = journal_input(chip, delta) / -10.0;
 
     for(int i = 0; i < 10; i++)
     {
@@ -804,6 +818,8 @@ void ThrottleDesc<THROTTLE>::throttle_input(Chip* chip, int mask)
     if(*pos < 0.0) *pos = 0.0;
     else if(*pos > 100.0) *pos = 100.0;
 
+    *pos = journal_input(chip, *pos);
+
     chip->deactivate_outputs(); // TODO: does this improve things?
     //chip->state = PASSIVE;
     //chip->active_outputs = (1 << chip->output_links.size()) - 1;
@@ -829,111 +845,6 @@ CHIP_DESC( THROTTLE1_INPUT ) =
 
 
 
-Input::Input()
-{ 
-    joysticks.resize(SDL_NumJoysticks());
-
-    for(int i = 0; i < joysticks.size(); i++)
-        joysticks[i] = SDL_JoystickOpen(i);
-        // TODO: check if joystick failed to open
-}
-
-Input::~Input()
-{
-    for(int i = 0; i < joysticks.size(); i++)
-        if(joysticks[i]) SDL_JoystickClose(joysticks[i]);
-}
-
-void Input::poll_input()
-{
-    SDL_JoystickUpdate();
-
-    Application::processEvents();
-
-    ManyMouseEvent mouse_event;
-    while (ManyMouse_PollEvent(&mouse_event))
-    {
-        int mouse = mouse_event.device;
-        
-        if(mouse >= mouse_rel_x.size())
-        {
-            mouse_rel_x.resize(mouse+1);
-            mouse_rel_y.resize(mouse+1);
-        }
-
-        if (mouse_event.type == MANYMOUSE_EVENT_RELMOTION)
-        {
-            if(mouse_event.item == 0)
-                mouse_rel_x[mouse] += mouse_event.value;
-            else if (mouse_event.item == 1)
-                mouse_rel_y[mouse] += mouse_event.value;
-        }
-        else if (mouse_event.type == MANYMOUSE_EVENT_ABSMOTION)
-        {
-            // TODO: Handle absolute motion?
-            /*double val = (double) (mouse_event.value - mouse_event.minval);
-            double maxval = (double) (mouse_event.maxval - mouse_event.minval);
-            if (mouse_event.item == 0)
-                mouse->x = (val / maxval);
-            else if (mouse_event.item == 1)
-                mouse->y = (val / maxval);*/
-        }
-    }
-}
-
-int Input::getRelativeMouseX(unsigned mouse)
-{
-    if(mouse >= mouse_rel_x.size())
-    {
-        mouse_rel_x.resize(mouse+1);
-        mouse_rel_y.resize(mouse+1);
-    }
-
-    int x = mouse_rel_x[mouse];
-    mouse_rel_x[mouse] = 0;
-    return x;
-}
-
-int Input::getRelativeMouseY(unsigned mouse)
-{
-    if(mouse >= mouse_rel_y.size())
-    {
-        mouse_rel_x.resize(mouse+1);
-        mouse_rel_y.resize(mouse+1);
-    }
-
-    int y = mouse_rel_y[mouse];
-    mouse_rel_y[mouse] = 0;
-    return y;
-}
-
-bool Input::getKeyboardState(unsigned scancode)
-{
-    return Keyboard::pressed((Keyboard::Scancode)scancode);
-}
-
-bool Input::getJoystickButton(unsigned joystick, unsigned button)
-{
-    if(joystick >= joysticks.size()) return 0;
-    return SDL_JoystickGetButton(joysticks[joystick], button);
-}
-
-int16_t Input::getJoystickAxis(unsigned joystick, unsigned axis)
-{
-    if(joystick >= joysticks.size()) return 0;
-    return SDL_JoystickGetAxis(joysticks[joystick], axis);
-}
-
-int Input::getNumJoysticks()
-{
-    return joysticks.size();
-}
-
-int Input::getNumJoystickAxes(int joystick)
-{
-    return SDL_JoystickNumAxes(joysticks[joystick]);
-}
-
 bool Input::getKeyPressed(const KeyAssignment& key_assignment)
 {
     switch(key_assignment.type)
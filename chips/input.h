@@ -1,9 +1,10 @@
 #ifndef INPUT_H
 #define INPUT_H
 
+#include <cstring>
+#include <nall/serializer.hpp>
 #include "../chip_desc.h"
 #include "555mono.h"
-#include <SDL_joystick.h>
 
 struct KeyAssignment; // in settings.h
 
@@ -35,6 +36,8 @@ public:
     AnalogInputDesc(double min, double max, Mono555Desc* m) : min_val(min), max_val(max),
         current_val((max+min) / 2.0), mono_555(m) { }
 
+    void serialize(nall::serializer& s) { s(current_val); }
+    void relink(const CustomDataLinks& links) { links(mono_555); }
     static CUSTOM_LOGIC( analog_input );
 };
 
@@ -46,6 +49,8 @@ public:
     cirque<double> wheel_events[2];
 
     WheelDesc() : angle(0.0), wheel_events{cirque<double>(32), cirque<double>(32)} { }
+
+    void serialize(nall::serializer& s) { s(angle); s(wheel_events[0]); s(wheel_events[1]); }
 };
 
 template <unsigned THROTTLE>
@@ -55,6 +60,8 @@ class ThrottleDesc
 
 public:
     ThrottleDesc(double* p) : pos(p) { }
+    void serialize(nall::serializer& s) { } // Position is saved with the desc pos points at
+    void relink(const CustomDataLinks& links) { links(pos); }
 
     static CUSTOM_LOGIC( throttle_input );
 };
@@ -117,21 +124,21 @@ inline constexpr uint8_t operator"" _NC ( unsigned long long pin ) { return pin
 
 class Input
 {
-private:
-    std::vector<int> mouse_rel_x, mouse_rel_y;
-    std::vector<SDL_Joystick*> joysticks;
 public:
-    Input();
-    ~Input();
-    void poll_input();
+    virtual ~Input() { }
+    virtual void poll_input() = 0;
     
-    int getRelativeMouseX(unsigned mouse);
-    int getRelativeMouseY(unsigned mouse);
-    bool getKeyboardState(unsigned scancode);
-    bool getJoystickButton(unsigned joystick, unsigned button);
-    int16_t getJoystickAxis(unsigned joystick, unsigned axis);
-    int getNumJoysticks();
-    int getNumJoystickAxes(int joystick);
+    virtual int getRelativeMouseX(unsigned mouse) = 0;
+    virtual int getRelativeMouseY(unsigned mouse) = 0;
+    virtual bool getKeyboardState(unsigned scancode) = 0;
+    virtual bool getJoystickButton(unsigned joystick, unsigned button) = 0;
+    virtual int16_t getJoystickAxis(unsigned joystick, unsigned axis) = 0;
+    virtual int getNumJoysticks() = 0;
+    virtual int getNumJoystickAxes(int joystick) = 0;
+
+    // Absolute paddle position (0.0 - 1.0 across its range) supplied by a non-interactive back-end.
+    // Returns false when the paddle is left to the mouse, keyboard and joystick.
+    virtual bool getPaddlePosition(unsigned paddle, double& pos) { return false; }
     bool getKeyPressed(const KeyAssignment& key_assignment);
 };
 
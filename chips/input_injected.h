@@ -0,0 +1,135 @@
+#ifndef INPUT_INJECTED_H
+#define INPUT_INJECTED_H
+
+#include <cmath>
+#include <bitset>
+
+#include "input.h"
+#include "../settings.h"
+
+// Input back-end driven by the program instead of devices: keys, joystick buttons and axes
+// are set directly, and paddles can be given absolute positions. Used by Environment, and
+// with play() by dice_bench and --tune-hints.
+class InputInjected : public Input
+{
+public:
+    enum { MAX_KEYS = 512, MAX_JOYSTICKS = 8, MAX_BUTTONS = 32, MAX_AXES = 8, MAX_PADDLES = 4 };
+
+    static constexpr double PLAY_STEP = 1.0 / 60.0; // Seconds between play() calls
+
+    InputInjected() { clear(); }
+
+    void poll_input() { }
+
+    int getRelativeMouseX(unsigned mouse) { return 0; }
+    int getRelativeMouseY(unsigned mouse) { return 0; }
+
+    bool getKeyboardState(unsigned scancode)
+    {
+        return scancode < MAX_KEYS && keys[scancode];
+    }
+
+    bool getJoystickButton(unsigned joystick, unsigned button)
+    {
+        return joystick < MAX_JOYSTICKS && button < MAX_BUTTONS && buttons[joystick][button];
+    }
+
+    int16_t getJoystickAxis(unsigned joystick, unsigned axis)
+    {
+        return (joystick < MAX_JOYSTICKS && axis < MAX_AXES) ? axes[joystick][axis] : 0;
+    }
+
+    int getNumJoysticks() { return MAX_JOYSTICKS; }
+    int getNumJoystickAxes(int joystick) { return MAX_AXES; }
+
+    bool getPaddlePosition(unsigned paddle, double& pos)
+    {
+        if(paddle >= MAX_PADDLES || std::isnan(paddles[paddle])) return false;
+        pos = paddles[paddle];
+        return true;
+    }
+
+    // Release everything and hand the paddles back to their default positions
+    void clear()
+    {
+        keys.reset();
+        for(unsigned j = 0; j < MAX_JOYSTICKS; j++)
+        {
+            buttons[j].reset();
+            for(unsigned a = 0; a < MAX_AXES; a++) axes[j][a] = 0;
+        }
+        for(unsigned p = 0; p < MAX_PADDLES; p++) paddles[p] = NAN;
+    }
+
+    // Position from 0.0 to 1.0, NaN releases the paddle
+    void setPaddle(unsigned paddle, double pos)
+    {
+        if(paddle < MAX_PADDLES) paddles[paddle] = pos;
+    }
+
+    // Press or release whatever the key assignment is bound to
+    void setKey(const KeyAssignment& key, bool pressed)
+    {
+        switch(key.type)
+        {
+            case KeyAssignment::KEYBOARD:
+                if(key.button < MAX_KEYS) keys[key.button] = pressed;
+                break;
+            case KeyAssignment::JOYSTICK_BUTTON:
+                if(key.joystick < MAX_JOYSTICKS && key.button < MAX_BUTTONS) buttons[key.joystick][key.button] = pressed;
+                break;
+            case KeyAssignment::JOYSTICK_AXIS: // Low bit of button selects the direction
+                if(key.joystick < MAX_JOYSTICKS && (key.button >> 1) < MAX_AXES)
+                    axes[key.joystick][key.button >> 1] = pressed ? ((key.button & 1) ? 32767 : -32768) : 0;
+                break;
+            default: break;
+        }
+    }
+
+    // Scripted play, the same every run, at t emulated seconds: a coin and a start
+    // press, then the first two players' buttons tapped twice a second, their
+    // joysticks going round once a second, steering wheels turned left then right,
+    // the throttle open every other second and the paddles swept end to end every
+    // two seconds
+    void play(const Settings& settings, double t)
+    {
+        const Settings::Input& in = settings.input;
+
+        clear();
+
+        if(t >= 0.5 && t < 0.6) setKey(in.coin_start.coin1, true);
+        if(t >= 1.0 && t < 1.1) setKey(in.coin_start.start1, true);
+
+        if(fmod(t, 0.5) < 0.1)
+        {
+            setKey(in.buttons[0].button1, true);
+            setKey(in.buttons[1].button1, true);
+        }
+
+        unsigned quarter = unsigned(fmod(t, 1.0) * 4.0);
+        for(unsigned j = 0; j < 2; j++)
+        {
+            const Settings::Input::Joystick& js = in.joystick[j];
+            const KeyAssignment* direction[] = { &js.up, &js.right, &js.down, &js.left };
+            setKey(*direction[(quarter + 2 * j) & 3], true);
+        }
+
+        for(const Settings::Input::Wheel& w : in.wheel)
+            setKey(quarter < 2 ? w.left : w.right, true);
+
+        if(fmod(t, 2.0) < 1.0) setKey(in.throttle[0].key, true);
+
+        double sweep = fmod(t, 2.0);
+        double pos = sweep < 1.0 ? sweep : 2.0 - sweep;
+        for(unsigned p = 0; p < MAX_PADDLES; p++)
+            setPaddle(p, (p & 1) ? 1.0 - pos : pos);
+    }
+
+private:
+    std::bitset<MAX_KEYS> keys;
+    std::bitset<MAX_BUTTONS> buttons[MAX_JOYSTICKS];
+    int16_t axes[MAX_JOYSTICKS][MAX_AXES];
+    double paddles[MAX_PADDLES];
+};
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef INPUT_NULL_H
+#define INPUT_NULL_H
+
+#include "input.h"
+
+// Input back-end with no devices attached, for running circuits headless
+class InputNull : public Input
+{
+public:
+    void poll_input() { }
+
+    int getRelativeMouseX(unsigned mouse) { return 0; }
+    int getRelativeMouseY(unsigned mouse) { return 0; }
+    bool getKeyboardState(unsigned scancode) { return false; }
+    bool getJoystickButton(unsigned joystick, unsigned button) { return false; }
+    int16_t getJoystickAxis(unsigned joystick, unsigned axis) { return 0; }
+    int getNumJoysticks() { return 0; }
+    int getNumJoystickAxes(int joystick) { return 0; }
+};
+
+#endif
@@ -0,0 +1,112 @@
+#include "input_sdl.h"
+#include "../settings.h"
+
+#include "../manymouse/manymouse.h"
+#include <SDL.h>
+
+using namespace phoenix;
+
+InputSdl::InputSdl()
+{ 
+    joysticks.resize(SDL_NumJoysticks());
+
+    for(int i = 0; i < joysticks.size(); i++)
+        joysticks[i] = SDL_JoystickOpen(i);
+        // TODO: check if joystick failed to open
+}
+
+InputSdl::~InputSdl()
+{
+    for(int i = 0; i < joysticks.size(); i++)
+        if(joysticks[i]) SDL_JoystickClose(joysticks[i]);
+}
+
+void InputSdl::poll_input()
+{
+    SDL_JoystickUpdate();
+
+    Application::processEvents();
+
+    ManyMouseEvent mouse_event;
+    while (ManyMouse_PollEvent(&mouse_event))
+    {
+        int mouse = mouse_event.device;
+        
+        if(mouse >= mouse_rel_x.size())
+        {
+            mouse_rel_x.resize(mouse+1);
+            mouse_rel_y.resize(mouse+1);
+        }
+
+        if (mouse_event.type == MANYMOUSE_EVENT_RELMOTION)
+        {
+            if(mouse_event.item == 0)
+                mouse_rel_x[mouse] += mouse_event.value;
+            else if (mouse_event.item == 1)
+                mouse_rel_y[mouse] += mouse_event.value;
+        }
+        else if (mouse_event.type == MANYMOUSE_EVENT_ABSMOTION)
+        {
+            // TODO: Handle absolute motion?
+            /*double val = (double) (mouse_event.value - mouse_event.minval);
+            double maxval = (double) (mouse_event.maxval - mouse_event.minval);
+            if (mouse_event.item == 0)
+                mouse->x = (val / maxval);
+            else if (mouse_event.item == 1)
+                mouse->y = (val / maxval);*/
+        }
+    }
+}
+
+int InputSdl::getRelativeMouseX(unsigned mouse)
+{
+    if(mouse >= mouse_rel_x.size())
+    {
+        mouse_rel_x.resize(mouse+1);
+        mouse_rel_y.resize(mouse+1);
+    }
+
+    int x = mouse_rel_x[mouse];
+    mouse_rel_x[mouse] = 0;
+    return x;
+}
+
+int InputSdl::getRelativeMouseY(unsigned mouse)
+{
+    if(mouse >= mouse_rel_y.size())
+    {
+        mouse_rel_x.resize(mouse+1);
+        mouse_rel_y.resize(mouse+1);
+    }
+
+    int y = mouse_rel_y[mouse];
+    mouse_rel_y[mouse] = 0;
+    return y;
+}
+
+bool InputSdl::getKeyboardState(unsigned scancode)
+{
+    return Keyboard::pressed((Keyboard::Scancode)scancode);
+}
+
+bool InputSdl::getJoystickButton(unsigned joystick, unsigned button)
+{
+    if(joystick >= joysticks.size()) return 0;
+    return SDL_JoystickGetButton(joysticks[joystick], button);
+}
+
+int16_t InputSdl::getJoystickAxis(unsigned joystick, unsigned axis)
+{
+    if(joystick >= joysticks.size()) return 0;
+    return SDL_JoystickGetAxis(joysticks[joystick], axis);
+}
+
+int InputSdl::getNumJoysticks()
+{
+    return joysticks.size();
+}
+
+int InputSdl::getNumJoystickAxes(int joystick)
+{
+    return SDL_JoystickNumAxes(joysticks[joystick]);
+}
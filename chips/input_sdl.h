@@ -0,0 +1,26 @@
+#ifndef INPUT_SDL_H
+#define INPUT_SDL_H
+
+#include "input.h"
+#include <SDL_joystick.h>
+
+class InputSdl : public Input
+{
+private:
+    std::vector<int> mouse_rel_x, mouse_rel_y;
+    std::vector<SDL_Joystick*> joysticks;
+public:
+    InputSdl();
+    ~InputSdl();
+    void poll_input();
+    
+    int getRelativeMouseX(unsigned mouse);
+    int getRelativeMouseY(unsigned mouse);
+    bool getKeyboardState(unsigned scancode);
+    bool getJoystickButton(unsigned joystick, unsigned button);
+    int16_t getJoystickAxis(unsigned joystick, unsigned axis);
+    int getNumJoysticks();
+    int getNumJoystickAxes(int joystick);
+};
+
+#endif
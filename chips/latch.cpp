@@ -19,7 +19,7 @@
 static CUSTOM_LOGIC( latch_init )
 {
     chip->state = PASSIVE;
-    chip->active_outputs = (1 << chip->output_links.size()) - 1;   
+    chip->active_outputs = (1 << chip->output_count) - 1;   
     
     // Generate output event, called once at init
     chip->pending_event = chip->circuit->queue_push(chip, chip->delay[0]);
@@ -4,6 +4,7 @@
 #include "../chip_desc.h"
 #include "audio.h"
 #include <vector>
+#include <nall/serializer.hpp>
 
 class MixerDesc
 {
@@ -14,6 +15,7 @@ public:
     double c2; // optional
     
     MixerDesc(std::vector<double> _r, double _r1 = 0.0, double _c1 = 0.0, double _c2 = 0.0);
+    void serialize(nall::serializer& s) { s(v_c1); s(v_c2); }
     static CUSTOM_LOGIC( mixer );
     static CUSTOM_LOGIC( init );
 
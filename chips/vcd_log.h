@@ -5,6 +5,7 @@
 
 #include <cstdio>
 #include <map>
+#include <nall/serializer.hpp>
 
 /* 
     VCD Log:
@@ -53,6 +54,7 @@ public:
 			   int num31 = 31, const char* name31 = NULL);
 
     ~VcdLogDesc();
+    void serialize(nall::serializer& s) { } // Output only
 
     static CUSTOM_LOGIC( vcd_log );
 };
@@ -1,12 +1,5 @@
-#include <phoenix.hpp>
-#include <GL/gl.h>
-
 #include "video.h"
 #include "../circuit.h"
-#include "video_sdl.h"
-
-using phoenix::VerticalLayout;
-using phoenix::Viewport;
 
 /* 
 	Inputs:
@@ -55,89 +48,19 @@ CHIP_DESC( VIDEO ) =
 const VideoDesc VideoDesc::DEFAULT = VideoDesc();
 
 Video::Video() : scanline_time(0), current_time(0), initial_time(0), 
-    v_size(0), v_pos(0), frame_count(0), desc(&VideoDesc::DEFAULT), color(3 << 8)
+    v_size(0), v_pos(0), frame_count(0), visible(true), desc(&VideoDesc::DEFAULT), color(3 << 8)
 { }
 
 void Video::video_init(int width, int height, const Settings::Video& settings)
 {
-    // Keep aspect ratio
-    unsigned x = 0;
-    unsigned y = 0;
-
-    bool horizontal = true;
-    if(desc->orientation == ROTATE_90 || desc->orientation == ROTATE_270)
-        horizontal = false;        
-
-    if(settings.keep_aspect && horizontal)
-    {
-        if(width > 4*height/3)
-        {
-            x = (width - 4*height/3) / 2;
-            width = 4*height/3;
-        }
-        else if(height > 3*width/4)
-        {
-            y = (height - 3*width/4) / 2;
-            height = 3*width/4;
-        }
-    }
-    else if(settings.keep_aspect) // vertical
-    {
-        if(width > 3*height/4)
-        {
-            x = (width - 3*height/4) / 2;
-            width = 3*height/4;
-        }
-        else if(height > 4*width/3)
-        {
-            y = (height - 4*width/3) / 2;
-            height = 4*width/3;
-        }
-    }
-
-   	glViewport(x, y, width, height);
-
     adjust_screen_params();
 }
 
 Video::~Video()
-{
-    if (glContext) {
-        SDL_GL_DeleteContext(glContext);
-        glContext = nullptr;
-    }
-
-    if (g_window) {
-        SDL_DestroyWindow(g_window);
-        g_window = nullptr;
-    }
-
-    SDL_ShowCursor(SDL_ENABLE);
-}
+{ }
 
 void Video::adjust_screen_params()
 {
-    glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-
-    switch(desc->orientation)
-    {
-        case ROTATE_90: glRotatef(90.0, 0.0, 0.0, -1.0); break;
-        case ROTATE_180: glRotatef(180.0, 0.0, 0.0, -1.0); break;
-        case ROTATE_270: glRotatef(270.0, 0.0, 0.0, -1.0); break;
-        default: break;
-    }    
-    glOrtho(0.0, scanline_time, v_size, 0.0, -1.0, 1.0);
-
-	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-
-    // Clear screen
-	glClearColor(0, 0, 0, 0);
-	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
-	swap_buffers();
-	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
-
     if(desc->monitor_type == COLOR)
     {
         init_color_lut(desc->r_color);
@@ -194,51 +117,22 @@ void Video::init_color_lut(const double (*r)[3])
     }
 }
 
-void Video::draw(Chip* chip)
+void Video::serialize(nall::serializer& s)
 {
-    uint64_t start_time = current_time - initial_time;
-    uint64_t end_time = chip->circuit->global_time - initial_time;
-
-    if((chip->inputs & VIDEO_MASK) || desc->scan_mode == INTERLACED) // Falling edge
-    {
-        float* c = &color[(chip->inputs & VIDEO_MASK) * 3];
-
-        glBegin(GL_QUADS);
-            glColor3fv(c);
-
-	        glVertex3f(start_time, v_pos,     0.0);
-	        glVertex3f(end_time,   v_pos,     0.0);
-	        glVertex3f(end_time,   v_pos+1.0, 0.0);
-	        glVertex3f(start_time, v_pos+1.0, 0.0);
-	    glEnd(); 
-    }
-}
-
-void Video::draw_overlays()
-{
-    if(desc->overlays.empty()) return;
-
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_ZERO, GL_SRC_COLOR);
-
-    for(const VideoOverlay& o : desc->overlays)
-    {
-        double end_x = (o.width < 0.0) ? scanline_time : (o.x + o.width) / Circuit::timescale;
-        double end_y = (o.height < 0.0) ? v_size : o.y + o.height;
-        double start_x = o.x / Circuit::timescale;
-        double start_y = o.y;
-
-        glBegin(GL_QUADS);
-            glColor3f(o.r, o.g, o.b);
-
-	        glVertex3f(start_x, start_y, 0.0);
-	        glVertex3f(end_x,   start_y, 0.0);
-	        glVertex3f(end_x,   end_y,   0.0);
-	        glVertex3f(start_x, end_y,   0.0);
-	    glEnd();
-    }
-
-    glDisable(GL_BLEND);
+    uint64_t old_scanline_time = scanline_time;
+    uint32_t old_v_size = v_size;
+
+    s.integer(scanline_time);
+    s.integer(current_time);
+    s.integer(initial_time);
+    s.integer(v_size);
+    s.integer(v_pos);
+    s.integer(frame_count);
+
+    // Screen parameters follow the restored geometry. RunAhead loads every
+    // frame, the geometry rarely differs.
+    if(s.mode() == nall::serializer::Load && (scanline_time != old_scanline_time || v_size != old_v_size))
+        restore_screen_params();
 }
 
 CUSTOM_LOGIC( Video::video )
@@ -257,14 +151,11 @@ CUSTOM_LOGIC( Video::video )
             video->v_size = video->v_pos;
             video->adjust_screen_params();
         }
-        video->draw_overlays();
-        video->swap_buffers();
-        if(video->desc->scan_mode == PROGRESSIVE)
-            glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+        if(video->visible) video->end_frame();
         video->frame_count++;
         
         // Make sure real time is caught up
-        if(chip->circuit->settings.throttle)
+        if(chip->circuit->settings.throttle && !chip->circuit->speculative)
             while(chip->circuit->rtc.get_usecs() < uint64_t(global_time * 1000000.0 * Circuit::timescale));
     }
     // HBLANK rising edge, go to next line
@@ -279,7 +170,7 @@ CUSTOM_LOGIC( Video::video )
             video->adjust_screen_params();
         }
 
-        video->draw(chip);
+        if(video->visible) video->draw(chip);
 
         if(video->desc->scan_mode == INTERLACED)
             video->v_pos += 2;
@@ -303,11 +194,9 @@ CUSTOM_LOGIC( Video::video )
     // Draw video
     else if(!(chip->inputs & (HBLANK_MASK|VBLANK_MASK)))
     {
-        video->draw(chip);     
+        if(video->visible) video->draw(chip);
     }
 
     chip->inputs ^= mask;
     video->current_time = global_time;
 }
-
-Video* Video::createDefault(VerticalLayout& layout, Viewport*& viewport) { return new VideoSdl(viewport->handle()); }
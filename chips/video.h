@@ -3,11 +3,11 @@
 
 class Video;
 
-#include <SDL.h>
+#include <cstring>
+#include <nall/serializer.hpp>
 #include "../chip_desc.h"
 #include "../video_desc.h"
 #include "../settings.h"
-#include "../globals.h"
 
 class Video
 {
@@ -21,23 +21,26 @@ protected:
 
     std::vector<float> color;
 
-    void adjust_screen_params();
-    void draw(Chip* chip);
-    void draw_overlays();
+    virtual void adjust_screen_params();
+    virtual void restore_screen_params() { adjust_screen_params(); } // After loading a state with other geometry
+    virtual void draw(Chip* chip) { }
+    virtual void end_frame() { }
     void init_color_lut(const double (*r)[3]);
 
 public:
     const VideoDesc* desc;
     uint32_t frame_count;
+    bool visible; // While false frames are scanned but not drawn or shown (RunAhead)
     enum VideoPins { HBLANK_PIN = 9, VBLANK_PIN = 10 };
 
-    SDL_GLContext glContext = nullptr;
-    
     Video();
-    ~Video();
+    virtual ~Video();
     virtual void video_init(int width, int height, const Settings::Video& settings);
     virtual void swap_buffers() = 0;
     virtual void show_cursor(bool show) = 0;
+
+    // Scan position and frame counter, saved with the circuit state
+    virtual void serialize(nall::serializer& s);
     static CUSTOM_LOGIC( video );
 
     static Video* createDefault(phoenix::VerticalLayout& layout, phoenix::Viewport*& viewport);
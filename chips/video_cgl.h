@@ -7,16 +7,16 @@
 #include <OpenGL/gl.h>
 #include <OpenGL/gl3.h>
 
-#include "video.h"
+#include "video_gl.h"
 
-class VideoCgl : public Video
+class VideoCgl : public VideoOpenGL
 {
 private:
     NSOpenGLView* view;
     NSView* handle;
 
 public:
-    VideoCgl(uintptr_t h) : Video(), handle((NSView*)h), view(nil) { }
+    VideoCgl(uintptr_t h) : VideoOpenGL(), handle((NSView*)h), view(nil) { }
 
     ~VideoCgl()
     {
@@ -57,7 +57,7 @@ public:
             
             [view lockFocus];
 
-            Video::video_init(width, height, settings);
+            VideoOpenGL::video_init(width, height, settings);
 
             [view unlockFocus];
         }
@@ -0,0 +1,119 @@
+#include <cstring>
+#include <algorithm>
+
+#include "video_framebuffer.h"
+#include "../circuit.h"
+
+#define VIDEO_MASK ((1 << 8) - 1)
+
+static inline uint8_t to_byte(double c)
+{
+    if(c <= 0.0) return 0;
+    if(c >= 1.0) return 255;
+    return uint8_t(c * 255.0 + 0.5);
+}
+
+static inline double luminance(double r, double g, double b)
+{
+    return 0.299*r + 0.587*g + 0.114*b;
+}
+
+VideoFramebuffer::VideoFramebuffer(unsigned w, unsigned h, Format f) : Video(),
+    width(w), height(h), format(f), back(w * h * f, 0), front(w * h * f, 0)
+{
+    memset(pixel_lut, 0, sizeof(pixel_lut));
+}
+
+void VideoFramebuffer::adjust_screen_params()
+{
+    Video::adjust_screen_params();
+
+    for(int i = 0; i < 256; i++)
+    {
+        const float* c = &color[i * 3];
+        if(format == LUMA8)
+            pixel_lut[i][0] = to_byte(luminance(c[0], c[1], c[2]));
+        else for(int j = 0; j < 3; j++)
+            pixel_lut[i][j] = to_byte(c[j]);
+    }
+
+    // Geometry changed, old contents no longer line up
+    std::fill(back.begin(), back.end(), 0);
+}
+
+void VideoFramebuffer::serialize(nall::serializer& s)
+{
+    // Restores the geometry first, which clears the back buffer
+    Video::serialize(s);
+
+    s.array(back.data(), back.size());
+    s.array(front.data(), front.size());
+}
+
+void VideoFramebuffer::draw(Chip* chip)
+{
+    if(scanline_time == 0 || v_size == 0 || v_pos >= v_size) return;
+
+    // Progressive frames start out black, so only interlaced fields need black spans drawn
+    uint8_t v = chip->inputs & VIDEO_MASK;
+    if(v == 0 && desc->scan_mode != INTERLACED) return;
+
+    uint64_t start_time = current_time - initial_time;
+    uint64_t end_time = std::min(chip->circuit->global_time - initial_time, scanline_time);
+    if(start_time >= end_time) return;
+
+    unsigned x0 = start_time * width / scanline_time;
+    unsigned x1 = end_time * width / scanline_time;
+    unsigned y0 = uint64_t(v_pos) * height / v_size;
+    unsigned y1 = uint64_t(v_pos + 1) * height / v_size;
+
+    for(unsigned y = y0; y < y1; y++)
+    {
+        uint8_t* p = &back[(y * width + x0) * format];
+        if(format == LUMA8)
+            memset(p, pixel_lut[v][0], x1 - x0);
+        else for(unsigned x = x0; x < x1; x++, p += 3)
+        {
+            p[0] = pixel_lut[v][0];
+            p[1] = pixel_lut[v][1];
+            p[2] = pixel_lut[v][2];
+        }
+    }
+}
+
+void VideoFramebuffer::draw_overlays()
+{
+    // Multiply blend, matching the OpenGL renderer
+    for(const VideoOverlay& o : desc->overlays)
+    {
+        double end_x = (o.width < 0.0) ? scanline_time : (o.x + o.width) / Circuit::timescale;
+        double end_y = (o.height < 0.0) ? v_size : o.y + o.height;
+
+        unsigned x0 = std::min<double>(width, o.x / Circuit::timescale * width / scanline_time);
+        unsigned x1 = std::min<double>(width, end_x * width / scanline_time);
+        unsigned y0 = std::min<double>(height, o.y * height / v_size);
+        unsigned y1 = std::min<double>(height, end_y * height / v_size);
+
+        double m[3] = { o.r, o.g, o.b };
+        if(format == LUMA8) m[0] = luminance(o.r, o.g, o.b);
+
+        for(unsigned y = y0; y < y1; y++)
+        {
+            uint8_t* p = &front[(y * width + x0) * format];
+            for(unsigned i = 0; i < (x1 - x0) * format; i++)
+                p[i] = to_byte(p[i] * m[i % format] / 255.0);
+        }
+    }
+}
+
+void VideoFramebuffer::end_frame()
+{
+    if(scanline_time == 0 || v_size == 0) return;
+
+    front = back;
+    draw_overlays();
+
+    // Interlaced fields only redraw every other line, so keep the previous field
+    if(desc->scan_mode == PROGRESSIVE)
+        std::fill(back.begin(), back.end(), 0);
+}
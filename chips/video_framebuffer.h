@@ -0,0 +1,42 @@
+#ifndef VIDEO_FRAMEBUFFER_H
+#define VIDEO_FRAMEBUFFER_H
+
+#include "video.h"
+
+// Software renderer that rasterizes scanlines into a fixed-size CPU pixel array.
+// The completed frame is published on every VBLANK and can be read with frame().
+// The image is in scan order, desc->orientation is not applied.
+class VideoFramebuffer : public Video
+{
+public:
+    enum Format { LUMA8 = 1, RGB24 = 3 }; // Value is the number of bytes per pixel
+
+    VideoFramebuffer(unsigned width = 320, unsigned height = 240, Format format = LUMA8);
+
+    void swap_buffers() { }
+    void show_cursor(bool show) { }
+
+    const uint8_t* frame() const { return front.data(); }
+    unsigned frameWidth() const { return width; }
+    unsigned frameHeight() const { return height; }
+    Format frameFormat() const { return format; }
+    size_t frameSize() const { return front.size(); }
+
+    void serialize(nall::serializer& s);
+
+protected:
+    void adjust_screen_params();
+    void draw(Chip* chip);
+    void end_frame();
+
+private:
+    unsigned width, height;
+    Format format;
+    std::vector<uint8_t> back;  // Frame being drawn
+    std::vector<uint8_t> front; // Last completed frame
+    uint8_t pixel_lut[256][3];  // Video input -> pixel bytes, built from color
+
+    void draw_overlays();
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include <phoenix.hpp>
+#include <GL/gl.h>
+
+#include "video_gl.h"
+#include "../circuit.h"
+#include "video_sdl.h"
+
+using phoenix::VerticalLayout;
+using phoenix::Viewport;
+
+#define VIDEO_MASK ((1 << 8) - 1)
+
+void VideoOpenGL::video_init(int width, int height, const Settings::Video& settings)
+{
+    // Keep aspect ratio
+    unsigned x = 0;
+    unsigned y = 0;
+
+    bool horizontal = true;
+    if(desc->orientation == ROTATE_90 || desc->orientation == ROTATE_270)
+        horizontal = false;        
+
+    if(settings.keep_aspect && horizontal)
+    {
+        if(width > 4*height/3)
+        {
+            x = (width - 4*height/3) / 2;
+            width = 4*height/3;
+        }
+        else if(height > 3*width/4)
+        {
+            y = (height - 3*width/4) / 2;
+            height = 3*width/4;
+        }
+    }
+    else if(settings.keep_aspect) // vertical
+    {
+        if(width > 3*height/4)
+        {
+            x = (width - 3*height/4) / 2;
+            width = 3*height/4;
+        }
+        else if(height > 4*width/3)
+        {
+            y = (height - 4*width/3) / 2;
+            height = 4*width/3;
+        }
+    }
+
+   	glViewport(x, y, width, height);
+
+    adjust_screen_params();
+}
+
+void VideoOpenGL::set_projection()
+{
+    glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+
+    switch(desc->orientation)
+    {
+        case ROTATE_90: glRotatef(90.0, 0.0, 0.0, -1.0); break;
+        case ROTATE_180: glRotatef(180.0, 0.0, 0.0, -1.0); break;
+        case ROTATE_270: glRotatef(270.0, 0.0, 0.0, -1.0); break;
+        default: break;
+    }    
+    glOrtho(0.0, scanline_time, v_size, 0.0, -1.0, 1.0);
+
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+}
+
+void VideoOpenGL::adjust_screen_params()
+{
+    set_projection();
+
+    // Clear screen
+	glClearColor(0, 0, 0, 0);
+	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+	swap_buffers();
+	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+
+    Video::adjust_screen_params();
+}
+
+// A loaded state goes on drawing the frame it was saved in: no clearing,
+// and above all no swap, that would show a black frame
+void VideoOpenGL::restore_screen_params()
+{
+    set_projection();
+    Video::adjust_screen_params();
+}
+
+void VideoOpenGL::draw(Chip* chip)
+{
+    uint64_t start_time = current_time - initial_time;
+    uint64_t end_time = chip->circuit->global_time - initial_time;
+
+    if((chip->inputs & VIDEO_MASK) || desc->scan_mode == INTERLACED) // Falling edge
+    {
+        float* c = &color[(chip->inputs & VIDEO_MASK) * 3];
+
+        glBegin(GL_QUADS);
+            glColor3fv(c);
+
+	        glVertex3f(start_time, v_pos,     0.0);
+	        glVertex3f(end_time,   v_pos,     0.0);
+	        glVertex3f(end_time,   v_pos+1.0, 0.0);
+	        glVertex3f(start_time, v_pos+1.0, 0.0);
+	    glEnd(); 
+    }
+}
+
+void VideoOpenGL::draw_overlays()
+{
+    if(desc->overlays.empty()) return;
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ZERO, GL_SRC_COLOR);
+
+    for(const VideoOverlay& o : desc->overlays)
+    {
+        double end_x = (o.width < 0.0) ? scanline_time : (o.x + o.width) / Circuit::timescale;
+        double end_y = (o.height < 0.0) ? v_size : o.y + o.height;
+        double start_x = o.x / Circuit::timescale;
+        double start_y = o.y;
+
+        glBegin(GL_QUADS);
+            glColor3f(o.r, o.g, o.b);
+
+	        glVertex3f(start_x, start_y, 0.0);
+	        glVertex3f(end_x,   start_y, 0.0);
+	        glVertex3f(end_x,   end_y,   0.0);
+	        glVertex3f(start_x, end_y,   0.0);
+	    glEnd();
+    }
+
+    glDisable(GL_BLEND);
+}
+
+void VideoOpenGL::end_frame()
+{
+    draw_overlays();
+    swap_buffers();
+    if(desc->scan_mode == PROGRESSIVE)
+        glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+}
+
+Video* Video::createDefault(VerticalLayout& layout, Viewport*& viewport) { return new VideoSdl(viewport->handle()); }
@@ -0,0 +1,22 @@
+#ifndef VIDEO_GL_H
+#define VIDEO_GL_H
+
+#include "video.h"
+
+// Immediate mode OpenGL renderer shared by the windowed back-ends
+class VideoOpenGL : public Video
+{
+protected:
+    void adjust_screen_params();
+    void restore_screen_params();
+    void set_projection();
+    void draw(Chip* chip);
+    void draw_overlays();
+    void end_frame();
+
+public:
+    VideoOpenGL() : Video() { }
+    void video_init(int width, int height, const Settings::Video& settings);
+};
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef VIDEO_NULL_H
+#define VIDEO_NULL_H
+
+#include "video.h"
+
+// Video back-end that discards all output, for running circuits headless
+class VideoNull : public Video
+{
+public:
+    VideoNull() : Video() { }
+
+    void swap_buffers() { }
+    void show_cursor(bool show) { }
+};
+
+#endif
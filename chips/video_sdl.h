@@ -5,16 +5,32 @@
 #include <SDL_opengl.h>
 #define glGetProcAddress(name) SDL_GL_GetProcAddress(name)
 
-#include "video.h"
+#include "video_gl.h"
 #include "../globals.h"
 
-class VideoSdl : public Video
+class VideoSdl : public VideoOpenGL
 {
 private:
     uintptr_t handle;
+    SDL_GLContext glContext = nullptr;
 
 public:
-    VideoSdl(uintptr_t h) : Video(), handle(h) { }
+    VideoSdl(uintptr_t h) : VideoOpenGL(), handle(h) { }
+
+    ~VideoSdl()
+    {
+        if (glContext) {
+            SDL_GL_DeleteContext(glContext);
+            glContext = nullptr;
+        }
+
+        if (g_window) {
+            SDL_DestroyWindow(g_window);
+            g_window = nullptr;
+        }
+
+        SDL_ShowCursor(SDL_ENABLE);
+    }
 
 
     void video_init(int width, int height, const Settings::Video& settings)
@@ -67,7 +83,7 @@ public:
 	SDL_SetWindowInputFocus(g_window);
 	SDL_ShowCursor(SDL_DISABLE);
 
-        Video::video_init(width, height, settings);
+        VideoOpenGL::video_init(width, height, settings);
     }
     
     void swap_buffers()
@@ -0,0 +1,24 @@
+#include <algorithm>
+
+#include "video_spans.h"
+#include "../circuit.h"
+
+#define VIDEO_MASK ((1 << 8) - 1)
+
+void VideoSpans::draw(Chip* chip)
+{
+    if(scanline_time == 0 || v_size == 0 || v_pos >= v_size) return;
+
+    // Black spans too, a picture can differ by one
+    uint64_t start_time = current_time - initial_time;
+    uint64_t end_time = std::min(chip->circuit->global_time - initial_time, scanline_time);
+    if(start_time >= end_time) return;
+
+    back.push_back({ v_pos, start_time, end_time, uint32_t(chip->inputs & VIDEO_MASK) });
+}
+
+void VideoSpans::end_frame()
+{
+    front.swap(back);
+    back.clear();
+}
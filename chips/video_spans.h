@@ -0,0 +1,41 @@
+#ifndef VIDEO_SPANS_H
+#define VIDEO_SPANS_H
+
+#include <vector>
+
+#include "video.h"
+
+// Records what would be drawn instead of drawing it: every level of the video
+// inputs with the scanline and the part of it it covered, exact to the emulated
+// time. Completed frames are published on every VBLANK and can be read with
+// frame(). Circuits drawing the same picture record the same spans (OptimizerVerifier).
+class VideoSpans : public Video
+{
+public:
+    struct Span
+    {
+        uint32_t line;       // Scanline, v_pos
+        uint64_t start, end; // Emulated time since the start of the scanline
+        uint32_t value;      // Video inputs
+
+        bool operator==(const Span& s) const { return line == s.line && start == s.start && end == s.end && value == s.value; }
+        bool operator!=(const Span& s) const { return !(*this == s); }
+    };
+
+    VideoSpans() : Video() { }
+
+    void swap_buffers() { }
+    void show_cursor(bool show) { }
+
+    const std::vector<Span>& frame() const { return front; }
+
+protected:
+    void draw(Chip* chip);
+    void end_frame();
+
+private:
+    std::vector<Span> back;  // Frame being drawn
+    std::vector<Span> front; // Last completed frame
+};
+
+#endif
@@ -5,7 +5,7 @@
 #include <GL/glext.h>
 #include <GL/wglext.h>
 #include <phoenix.hpp>
-#include "video.h"
+#include "video_gl.h"
 
 using namespace phoenix;
 
@@ -35,7 +35,7 @@ static bool wglExtensionSupportedARB(const char *extension_name, HDC dc)
     return true;
 }
 
-class VideoWgl : public Video
+class VideoWgl : public VideoOpenGL
 {
 private:
     VerticalLayout& layout;
@@ -51,7 +51,7 @@ private:
     bool initMultisampling();
 
 public:
-    VideoWgl(VerticalLayout& l, Viewport*& v) : Video(), layout(l), viewport(v), 
+    VideoWgl(VerticalLayout& l, Viewport*& v) : VideoOpenGL(), layout(l), viewport(v), 
         window((HWND)v->handle()), wglcontext(0), multisample(0) { }
 
     ~VideoWgl()
@@ -123,7 +123,7 @@ public:
             if(wglSwapIntervalEXT) wglSwapIntervalEXT(settings.vsync);
         }
 
-        Video::video_init(width, height, settings);
+        VideoOpenGL::video_init(width, height, settings);
     }
     
     void swap_buffers()
@@ -4,6 +4,7 @@
 #include "../chip_desc.h"
 
 #include <cstdio>
+#include <nall/serializer.hpp>
 
 /* 
     WAV Log:
@@ -22,6 +23,7 @@ public:
 	WavLogDesc(const char* filename, double g = 10.0);
 
     ~WavLogDesc();
+    void serialize(nall::serializer& s) { } // Output only
 
     static CUSTOM_LOGIC( wav_log );
 };
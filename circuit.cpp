@@ -1,9 +1,15 @@
 #include "circuit.h"
 #include "circuit_desc.h"
+#include "netlist_image.h"
+#include "hint_table.h"
 
+#include <algorithm>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <string>
 #include <sstream>
+#include <cstring>
 #include <cstdio>
 
 #define DEBUG
@@ -28,10 +34,10 @@ CHIP_DESC( _GND ) =
 // on chips where they do not perform well
 CUSTOM_LOGIC( deoptimize )
 {
-    for(ChipLink& cl : chip->output_links)
+    for(int i = 0; i < chip->output_count; i++)
     {
-        printf("Deoptimizing %p\n", cl.chip);
-        cl.chip->optimization_disabled = true;
+        printf("Deoptimizing %p\n", chip->output_chip(i));
+        chip->output_chip(i)->optimization_disabled = true;
     }
 }
 
@@ -48,54 +54,72 @@ class CircuitBuilder
 private:
     typedef std::pair<Chip*, const ChipDesc*> ChipDescPair;
 	typedef std::pair<uint8_t, ChipDescPair> Connection;
-    typedef std::multimap<std::string, ChipDescPair>::iterator ChipMapIterator;
+    typedef std::vector<ChipDescPair> ChipGroup; // Sub-chips of one chip instance, in creation order
+
+    // Instance names are interned: each gets an id, and chips are numbered in
+    // creation order through Chip::index (until freezeFanout renumbers them)
+    std::unordered_map<std::string, uint32_t> name_ids;
+    std::vector<std::string> names;          // By name id
+    std::vector<ChipGroup>   chip_groups;    // By name id
+    std::vector<uint32_t>    chip_names;     // Name id by chip number
+    std::vector<const ChipDesc*> chip_descs; // By chip number
+    std::vector<bool>        chip_hinted;    // By chip number, created by createChips()
+    HintTable                tuned_hints;    // Measured sizes, over the netlist's hints
+    bool                     hinted;         // Chips being created are sized by hints
+    std::string              prefixed;       // Scratch for prefixed names
 
-    typedef std::pair<std::string, uint8_t> Net;
-    typedef std::multimap<std::string, Net>::iterator NetListIterator;
-
-    std::multimap<std::string, ChipDescPair> chip_map;
-    std::multimap<std::string, Net> net_list;
     std::vector<Connection> connection_list_out, connection_list_in;
+    std::unordered_set<uint64_t> connected_inputs; // Chip number << 8 | pin
+    std::vector<std::vector<ChipLink>> output_links; // By chip number, packed into fanout by freezeFanout
 
     Circuit* circuit;
     std::vector<Chip*>& chips;
 
-    void createChip(const ChipDesc* chip_desc, std::string name, void* custom, int queue_size, int subcycle_size);
-    bool findConnection(const std::string& name1, const std::string& name2, const ConnectionDesc& connection);
+    // Building from a netlist image: only the chips it kept are created, linked as it says
+    const NetlistImage* image;
+    uint32_t image_source, image_chip; // Next creation number, next ChipRecord
+    std::vector<uint32_t> sources;     // Creation number by position, set by freezeFanout
+
+    void createChip(const ChipDesc* chip_desc, const std::string& name, void* custom, const void* lut_key, int queue_size, int subcycle_size);
+    void addChip(Chip* chip, const ChipDesc* desc, uint32_t name_id);
+    void addImageChip(const ChipDesc* desc, const std::string& name, void* custom, const void* lut_key, int queue_size, int subcycle_size);
+    void addCustomDataState(const ChipDesc* chip_desc, void* custom, const CustomDataCopier* copier);
+    void addConnection(const Connection& out, const Connection& in);
+    std::vector<ChipLink>& outputLinks(const Chip* chip) { return output_links[chip->index]; } // Until freezeFanout
+    void connect(Chip* out, Chip* in, const ChipDesc* desc, uint8_t pin);
+    const ChipGroup& findChips(const std::string& prefix, const char* name);
+    bool findConnection(const ChipGroup& chips1, const ChipGroup& chips2, const ConnectionDesc& connection);
 
 public:
-    CircuitBuilder(Circuit* cir, std::vector<Chip*>& ch) : circuit(cir), chips(ch) { }
+    CircuitBuilder(Circuit* cir, std::vector<Chip*>& ch) : hinted(false), circuit(cir), chips(ch), image(NULL), image_source(0), image_chip(0) { }
+
+    bool useImage(const NetlistImage* img, const CircuitDesc* desc);
+    const NetlistImage* fromImage() const { return image; }
+    void linkImage();
+    bool writeImage(const std::string& path, const char* game, unsigned removed);
+    void loadHints(const std::string& path) { tuned_hints.load(path); }
 
     void createChips(std::string prefix, const CircuitDesc* desc);
     void createSpecialChips();
     
     void findConnections(std::string prefix, const CircuitDesc* desc);
+    unsigned removeUnusedChips();
     void makeAllConnections();
+    void groundInput(Chip* chip, int input) { outputLinks(chips[1]).push_back(ChipLink(chip, 1 << input)); }
+    void freezeFanout();
 
     const std::string getOutputInfo(const Chip* chip)
     {
-        for(auto x : chip_map)
-            if(x.second.first == chip)
-            {
-                std::stringstream ss;
-                ss << x.first << "." << int(x.second.second->output_pin);
-                return ss.str();
-            }
-
-        return std::string("unknown");
+        std::stringstream ss;
+        ss << names[chip_names[chip->index]] << "." << int(chip_descs[chip->index]->output_pin);
+        return ss.str();
     }
 
     const std::string getInputInfo(const Chip* chip, int num)
     {
-        for(auto x : chip_map)
-            if(x.second.first == chip)
-            {
-                std::stringstream ss;
-                ss << x.first << "." << int(x.second.second->input_pins[num]);
-                return ss.str();
-            }
-
-        return std::string("unknown");
+        std::stringstream ss;
+        ss << names[chip_names[chip->index]] << "." << int(chip_descs[chip->index]->input_pins[num]);
+        return ss.str();
     }
 };
 
@@ -103,22 +127,51 @@ public:
 Circuit::Circuit(const Settings&  s,
                  Input&           i,
                  Video&           v,
+                 Audio&           a,
                  const CircuitDesc* desc,
                  const char*      name,
                  const std::string& dump_path,
-                 SampleMode       smode)
+                 SampleMode       smode,
+                 DumpFormat       dformat)
   : settings(s)
   , game_config(desc, name)
   , input(i)
   , video(v)
+  , audio(a)
+  , tables(std::make_shared<NetlistTables>())
   , global_time(0)
-  , queue_size(0)
+  , queue_type(s.event_queue)
+  , event_count(0)
+  , speculative(false)
   , recorder()                 // default‑initialise unique_ptr
   , last_frame_count(0)
+  , profile(nullptr)
+  , build_times()
 {
+    RealTimeClock build_clock;
+    uint64_t step_start = 0;
+    auto step_time = [&]()
+    {
+        uint64_t now = build_clock.get_usecs();
+        double t = (now - step_start) * 1.0e-6;
+        step_start = now;
+        return t;
+    };
 
     CircuitBuilder converter(this, chips);
 
+    // Chips and links come from the game's netlist image if there is a valid one,
+    // otherwise the netlist is built and the image written for next time
+    std::string image_path;
+    if(settings.netlist_images && NetlistImage::stamp() != 0)
+    {
+        image_path = NetlistImage::defaultPath(name);
+        converter.useImage(NetlistImage::open(image_path, name), desc);
+    }
+
+    if(settings.tuned_hints)
+        converter.loadHints(HintTable::defaultPath(name));
+
 
     // Construct special chips
     converter.createSpecialChips();
@@ -130,31 +183,63 @@ Circuit::Circuit(const Settings&  s,
     for(const SubcircuitDesc& d : desc->get_sub_circuits())
         converter.createChips(d.prefix, d.desc());
 
+    // Copies made from the netlist's descriptors point at each other's originals
+    std::vector<const void*> originals;
+    for(const CustomDataInstance& c : custom_data_copies)
+        originals.push_back(c.original);
+    relinkCustomData(originals);
+    build_times.chips = step_time();
 
-    // Create list of connections
-    converter.findConnections("", desc);
+    if(converter.fromImage())
+    {
+        build_times.from_image = true;
+        build_times.removed = converter.fromImage()->header().removed;
+        converter.linkImage();
+    }
+    else
+    {
+        // Create list of connections
+        converter.findConnections("", desc);
 
-    for(const SubcircuitDesc& d : desc->get_sub_circuits())
-        converter.findConnections(d.prefix, d.desc());
+        for(const SubcircuitDesc& d : desc->get_sub_circuits())
+            converter.findConnections(d.prefix, d.desc());
 
+        build_times.connections = step_time();
 
-    // Make all connections
-    converter.makeAllConnections();
 
+        // Remove unused chips, then make all connections
+        build_times.removed = converter.removeUnusedChips();
+        build_times.pruning = step_time();
 
-    // Check for unconnected inputs, connect to GND
-    for(int i = 2; i < chips.size(); i++)
-        for(int j = 0; j < chips[i]->input_links.size(); j++)
-            if(chips[i]->input_links[j].chip == NULL)
-            {
-                std::string name = converter.getInputInfo(chips[i], j);
+        converter.makeAllConnections();
 
-                if(chips[i]->type != CUSTOM_CHIP)
-                    printf("WARNING: Unconnected input pin: %s, connecting to GND\n", name.c_str());
-                
-                chips[1]->output_links.push_back(ChipLink(chips[i], 1 << j));
-                chips[i]->input_links[j] = ChipLink(chips[1], 0);
-            }
+
+        // Check for unconnected inputs, connect to GND
+        for(int i = 2; i < chips.size(); i++)
+            for(int j = 0; j < chips[i]->input_links.size(); j++)
+                if(chips[i]->input_links[j].chip == NULL)
+                {
+                    std::string name = converter.getInputInfo(chips[i], j);
+
+                    if(chips[i]->type != CUSTOM_CHIP)
+                        printf("WARNING: Unconnected input pin: %s, connecting to GND\n", name.c_str());
+                    
+                    converter.groundInput(chips[i], j);
+                    chips[i]->input_links[j] = ChipLink(chips[1], 0);
+                }
+    }
+
+
+    // The netlist is final, pack fan-out for the event loop
+    converter.freezeFanout();
+    build_times.linking = step_time();
+
+    if(!converter.fromImage() && !image_path.empty())
+    {
+        if(!converter.writeImage(image_path, name, build_times.removed))
+            printf("WARNING: Unable to write netlist image %s\n", image_path.c_str());
+        build_times.image = step_time();
+    }
 
 
     /*-------------------------------------------------*
@@ -163,7 +248,8 @@ Circuit::Circuit(const Settings&  s,
     if(!dump_path.empty()) {
         recorder.reset(new StateRecorder(dump_path,
                                         chips.size(),
-                                        smode));   // C++11‑safe
+                                        smode,
+                                        dformat));   // C++11‑safe
     }
 
 
@@ -184,25 +270,140 @@ Circuit::Circuit(const Settings&  s,
 
     // Run VCC
     chips[0]->output = 1;
-    for(LinkIterator it = chips[0]->output_links.begin(); it != chips[0]->output_links.end(); ++it)
-		it->chip->inputs |= it->mask;
+    for(int i = 0; i < chips[0]->output_count; i++)
+		chips[0]->output_chip(i)->inputs |= chips[0]->fanout[i].mask;
 
-	for(int i = 2; i < chips.size(); i++)
-		chips[i]->initialize();
+    settle();
+
+    build_times.init = step_time();
+    build_times.total = build_clock.get_usecs() * 1.0e-6;
 }
 
-void CircuitBuilder::createChip(const ChipDesc* chip_desc, std::string name, void* custom, int queue_size, int subcycle_size)
+// A chip is evaluated again each time one of its inputs changes, a ring
+// oscillator would be forever
+static const unsigned MAX_SETTLE_EVALUATIONS = 1024;
+
+// Brings power-on logic levels to a fixed point. Chips are evaluated in order,
+// when an output changes its fan-out is evaluated depth first, in link order,
+// before moving on. The stack of chips whose fan-out is being walked replaces
+// the recursion of Chip::initialize() so deep or cyclic logic can't overflow it.
+// A chip evaluated MAX_SETTLE_EVALUATIONS times is left as it is.
+void Circuit::settle()
 {
+    struct Walk
+    {
+        Chip* chip;
+        size_t link;
+    };
+
+    std::vector<uint16_t> evaluations(chips.size(), 0);
+    std::vector<Walk> stack;
+
+    unsigned total = 0, unsettled = 0;
+    auto evaluate = [&](Chip* c)
+    {
+        uint16_t& n = evaluations[c->index];
+        if(n >= MAX_SETTLE_EVALUATIONS)
+        {
+            if(n == MAX_SETTLE_EVALUATIONS) { n++; unsettled++; } // Counted once
+            return;
+        }
+        n++;
+        total++;
+
+        if(c->initialize())
+            stack.push_back(Walk{c, 0});
+    };
+
+    for(size_t i = 2; i < chips.size(); i++)
+    {
+        evaluate(chips[i]);
+
+        while(!stack.empty())
+        {
+            Walk& w = stack.back();
+            if(w.link == w.chip->output_count)
+            {
+                stack.pop_back();
+                continue;
+            }
+
+            Chip* next = w.chip->output_chip(w.link++);
+            if(next != w.chip) evaluate(next);
+        }
+    }
+
+    build_times.settle_evaluations = total;
+    build_times.unsettled = unsettled;
+}
+
+void CircuitBuilder::addChip(Chip* chip, const ChipDesc* desc, uint32_t name_id)
+{
+    chip->index = chip_names.size();
+    output_links.push_back(std::vector<ChipLink>());
+    chip_names.push_back(name_id);
+    chip_descs.push_back(desc);
+    chip_hinted.push_back(hinted);
+    chip_groups[name_id].push_back(ChipDescPair(chip, desc));
+    chips.push_back(chip);
+}
+
+void CircuitBuilder::addImageChip(const ChipDesc* desc, const std::string& name, void* custom, const void* lut_key, int queue_size, int subcycle_size)
+{
+    uint32_t source = image_source++;
+    const NetlistImage::Header& h = image->header();
+    if(image_chip == h.chip_count || image->chips()[image_chip].source != source) return; // Pruned
+
+    // Hand the mapped LUT to the pool for the Chip to find. One that doesn't fit
+    // in the image is left out and built as usual.
+    const NetlistImage::ChipRecord& r = image->chips()[image_chip++];
+    int lut_size = LutPool::lutSize(desc);
+    if(lut_size > 6 && r.lut + (1ull << (lut_size-5)) <= h.lut_words)
+    {
+        LutPool::Entry entry = { 0, image->luts() + r.lut };
+        LutPool::insert(desc, lut_key, entry, lut_size);
+    }
+    else if(lut_size > 0 && lut_size <= 6)
+    {
+        LutPool::Entry entry = { r.lut, NULL };
+        LutPool::insert(desc, lut_key, entry, lut_size);
+    }
+
+    Chip* chip = new Chip(queue_size, subcycle_size, circuit, desc, custom, lut_key);
+    chip->index = chips.size();
+    output_links.push_back(std::vector<ChipLink>());
+    chips.push_back(chip);
+
+    circuit->tables->chip_names.push_back(name + "." + std::to_string(int(desc->output_pin)));
+    circuit->tables->chip_hinted.push_back(hinted);
+    circuit->tables->chip_first_input.push_back(desc->input_pins[0]);
+}
+
+void CircuitBuilder::createChip(const ChipDesc* chip_desc, const std::string& name, void* custom, const void* lut_key, int queue_size, int subcycle_size)
+{
+    if(image)
+    {
+        for(const ChipDesc* d = chip_desc; !d->endOfDesc(); d++)
+            addImageChip(d, name, custom, lut_key, queue_size, subcycle_size);
+        return;
+    }
+
     std::map<uint8_t, ChipDescPair> output_pin_map;
     int chip = chips.size();
 
+    auto inserted = name_ids.insert(std::make_pair(name, uint32_t(names.size())));
+    uint32_t name_id = inserted.first->second;
+    if(inserted.second)
+    {
+        names.push_back(name);
+        chip_groups.push_back(ChipGroup());
+    }
+
     for(const ChipDesc* d = chip_desc; !d->endOfDesc(); d++)
     {
-        chips.push_back(new Chip(queue_size, subcycle_size, circuit, d, custom));
+        addChip(new Chip(queue_size, subcycle_size, circuit, d, custom, lut_key), d, name_id);
 
         ChipDescPair cd(chips.back(), d);
-        chip_map.insert(std::pair<std::string, ChipDescPair>(name, cd));
-
         if(d->output_pin) output_pin_map[d->output_pin] = cd;
 
         #ifdef DEBUG
@@ -214,27 +415,34 @@ void CircuitBuilder::createChip(const ChipDesc* chip_desc, std::string name, voi
     for(const ChipDesc* d = chip_desc; !d->endOfDesc(); d++, chip++)
         for(int i = 0; d->input_pins[i]; i++)
             if(output_pin_map.count(d->input_pins[i]))
-            {
-                connection_list_out.push_back(*output_pin_map.find(d->input_pins[i]));
-                connection_list_in.push_back(Connection(d->input_pins[i], ChipDescPair(chips[chip], d)));
-            }
+                addConnection(*output_pin_map.find(d->input_pins[i]), Connection(d->input_pins[i], ChipDescPair(chips[chip], d)));
 }
 
 void CircuitBuilder::createSpecialChips()
 {
     // Construct special chips
-    chips.push_back(new Chip(1, 64, circuit, chip__VCC));
-    chip_map.insert( std::pair<std::string, ChipDescPair>("_VCC", ChipDescPair(chips.back(), chip__VCC)) );
+    const char* special_names[] = { "_VCC", "_GND", "_DEOPTIMIZER" };
+    const ChipDesc* special_descs[] = { chip__VCC, chip__GND, chip__DEOPTIMIZER };
 
-    chips.push_back(new Chip(1, 64, circuit, chip__GND));
-    chip_map.insert( std::pair<std::string, ChipDescPair>("_GND", ChipDescPair(chips.back(), chip__GND)) );
+    for(int i = 0; i < 3; i++)
+    {
+        if(image)
+        {
+            addImageChip(special_descs[i], special_names[i], NULL, NULL, 1, 64);
+            continue;
+        }
 
-    chips.push_back(new Chip(1, 64, circuit, chip__DEOPTIMIZER));
-    chip_map.insert( std::pair<std::string, ChipDescPair>("_DEOPTIMIZER", ChipDescPair(chips.back(), chip__DEOPTIMIZER)) );
+        name_ids[special_names[i]] = names.size();
+        names.push_back(special_names[i]);
+        chip_groups.push_back(ChipGroup());
+
+        addChip(new Chip(1, 64, circuit, special_descs[i]), special_descs[i], i);
+    }
 
     // Create Video & Audio chips
-    createChip(chip_VIDEO, "VIDEO", &circuit->video, 8, 64);
-    createChip(chip_AUDIO, "AUDIO", &circuit->audio, 8, 64);
+    // Their LUT chips don't read custom_data, all circuits can share the LUTs
+    createChip(chip_VIDEO, "VIDEO", &circuit->video, NULL, 8, 64);
+    createChip(chip_AUDIO, "AUDIO", &circuit->audio, NULL, 8, 64);
 }
 
 void CircuitBuilder::createChips(std::string prefix, const CircuitDesc* desc)
@@ -246,6 +454,7 @@ void CircuitBuilder::createChips(std::string prefix, const CircuitDesc* desc)
         printf("Hinting %s\n", hint.chip);
         hint_list[hint.chip] = hint;
     }
+    hinted = true;
 
     // Find and construct all chips
     //std::map<const ChipDesc*, Chip*> desc_map; // Doesn't work with custom chips, TODO: fix
@@ -262,28 +471,76 @@ void CircuitBuilder::createChips(std::string prefix, const CircuitDesc* desc)
             subcycle_size = hint_list[instance.name].subcycle_size;
         }
 
-        createChip(instance.chip, prefix + instance.name, (void*)instance.custom_data, queue_size, subcycle_size);
+        if(const HintTable::Hint* tuned = tuned_hints.find(prefix + instance.name))
+        {
+            queue_size = tuned->queue_size;
+            subcycle_size = tuned->subcycle_size;
+        }
+
+        void* custom_data = (void*)instance.custom_data;
+        if(circuit->settings.copy_custom_data && instance.copier && custom_data)
+            custom_data = circuit->copyCustomData(custom_data, instance.copier);
+
+        // LUTs are keyed by the netlist's descriptor, a private copy has the same contents
+        createChip(instance.chip, prefix + instance.name, custom_data, (void*)instance.custom_data, queue_size, subcycle_size);
+
+        if(instance.copier && custom_data)
+            addCustomDataState(instance.chip, custom_data, instance.copier);
     }
 }
 
+void CircuitBuilder::addCustomDataState(const ChipDesc* chip_desc, void* custom, const CustomDataCopier* copier)
+{
+    // LUT chips only read custom_data while being built
+    bool custom_logic = false;
+    for(const ChipDesc* d = chip_desc; !d->endOfDesc(); d++)
+        if(d->custom_logic) custom_logic = true;
+
+    if(!custom_logic) return;
+
+    for(const Circuit::CustomDataState& c : circuit->custom_data_state)
+        if(c.data == custom) return;
+
+    Circuit::CustomDataState c = { custom, copier };
+    circuit->custom_data_state.push_back(c);
+}
+
+// Chips created under prefix + name, empty if there are none
+const CircuitBuilder::ChipGroup& CircuitBuilder::findChips(const std::string& prefix, const char* name)
+{
+    static const ChipGroup none;
+
+    prefixed.assign(prefix).append(name);
+    auto it = name_ids.find(prefixed);
+    return it == name_ids.end() ? none : chip_groups[it->second];
+}
+
 void CircuitBuilder::findConnections(std::string prefix, const CircuitDesc* desc)
 {
+    static const std::string no_prefix;
+
     // Create list of connections
     for(const ConnectionDesc& c : desc->get_connections())
     {
+        const ChipGroup& prefixed1 = findChips(prefix, c.name1);
+        const ChipGroup& prefixed2 = findChips(prefix, c.name2);
+
         // Try appending prefix to both signals first
-        if(findConnection(prefix + c.name1, prefix + c.name2, c)) continue;
+        if(findConnection(prefixed1, prefixed2, c)) continue;
         
         if(prefix.size() != 0)
         {
+            const ChipGroup& plain1 = findChips(no_prefix, c.name1);
+            const ChipGroup& plain2 = findChips(no_prefix, c.name2);
+
             // Try appending prefix to 1 signal only 
-            if(findConnection(prefix + c.name1, c.name2, c)) continue;
-            if(findConnection(c.name1, prefix + c.name2, c)) continue;
+            if(findConnection(prefixed1, plain2, c)) continue;
+            if(findConnection(plain1, prefixed2, c)) continue;
 
             // Try without prefix, but only if 1 of the signals already has prefix appended
             if((prefix.compare(0, prefix.size(), c.name1) == 0 ||
                 prefix.compare(0, prefix.size(), c.name2) == 0) &&
-                findConnection(c.name1, c.name2, c)) continue;
+                findConnection(plain1, plain2, c)) continue;
         }
         
         // No connection found
@@ -293,54 +550,42 @@ void CircuitBuilder::findConnections(std::string prefix, const CircuitDesc* desc
 
 }
 
-bool CircuitBuilder::findConnection(const std::string& name1, const std::string& name2, const ConnectionDesc& connection)
+void CircuitBuilder::addConnection(const Connection& out, const Connection& in)
 {
-    ChipMapIterator it1, it2;
-    std::pair<ChipMapIterator, ChipMapIterator> range1, range2;
+    const Chip* chip = in.second.first;
+    if(!connected_inputs.insert(uint64_t(chip->index) << 8 | in.first).second)
+        printf("WARNING: Attempted multiple connections to input: %s.%d\n", names[chip_names[chip->index]].c_str(), in.first);
 
-    range1 = chip_map.equal_range(name1);
-    range2 = chip_map.equal_range(name2);
+    connection_list_out.push_back(out);
+    connection_list_in.push_back(in);
+}
 
+bool CircuitBuilder::findConnection(const ChipGroup& chips1, const ChipGroup& chips2, const ConnectionDesc& connection)
+{
     // Find output pin
     bool connected = false;
-    for(it1 = range1.first; it1 != range1.second; ++it1)
-        if(it1->second.second->output_pin == connection.pin1)
+    for(const ChipDescPair& c1 : chips1)
+        if(c1.second->output_pin == connection.pin1)
         {
-            for(it2 = range2.first; it2 != range2.second; ++it2)
-                for(int i = 0; it2->second.second->input_pins[i]; i++)
-                    if(it2->second.second->input_pins[i] == connection.pin2)
+            for(const ChipDescPair& c2 : chips2)
+                for(int i = 0; c2.second->input_pins[i]; i++)
+                    if(c2.second->input_pins[i] == connection.pin2)
                     {
-                        if(std::find(connection_list_in.begin(), connection_list_in.end(), Connection(connection.pin2, it2->second)) != connection_list_in.end())
-                        {
-                            printf("WARNING: Attempted multiple connections to input: %s.%d\n", name2.c_str(), connection.pin2);
-                        }
-                        //else
-                        {
-                            connected = true;
-                            connection_list_out.push_back(Connection(connection.pin1, it1->second));
-                            connection_list_in.push_back(Connection(connection.pin2, it2->second));
-                        }
+                        connected = true;
+                        addConnection(Connection(connection.pin1, c1), Connection(connection.pin2, c2));
                     }
             break;
         }
 
-    for(it2 = range2.first; it2 != range2.second; ++it2)
-        if(it2->second.second->output_pin == connection.pin2)
+    for(const ChipDescPair& c2 : chips2)
+        if(c2.second->output_pin == connection.pin2)
         {
-            for(it1 = range1.first; it1 != range1.second; ++it1)
-                for(int i = 0; it1->second.second->input_pins[i]; i++)
-                    if(it1->second.second->input_pins[i] == connection.pin1)
+            for(const ChipDescPair& c1 : chips1)
+                for(int i = 0; c1.second->input_pins[i]; i++)
+                    if(c1.second->input_pins[i] == connection.pin1)
                     {
-                        if(std::find(connection_list_in.begin(), connection_list_in.end(), Connection(connection.pin1, it1->second)) != connection_list_in.end())
-                        {
-                            printf("WARNING: Attempted multiple connections to input: %s.%d\n", name1.c_str(), connection.pin1);
-                        }
-                        //else
-                        {
-                            connected = true;
-                            connection_list_out.push_back(Connection(connection.pin2, it2->second));
-                            connection_list_in.push_back(Connection(connection.pin1, it1->second));
-                        }
+                        connected = true;
+                        addConnection(Connection(connection.pin2, c2), Connection(connection.pin1, c1));
                     }
             break;
         }
@@ -348,51 +593,72 @@ bool CircuitBuilder::findConnection(const std::string& name1, const std::string&
     return connected;
 }
 
+// Deletes chips whose outputs aren't connected, repeating for the chips that
+// only drove those. Each connection is visited once.
+unsigned CircuitBuilder::removeUnusedChips()
+{
+    size_t chip_count = chip_names.size(), connection_count = connection_list_out.size();
 
+    // Connections driven by each chip, connections into each chip grouped by chip
+    std::vector<uint32_t> fanout_count(chip_count, 0), inputs_start(chip_count + 1, 0);
+    for(size_t i = 0; i < connection_count; i++)
+    {
+        fanout_count[connection_list_out[i].second.first->index]++;
+        inputs_start[connection_list_in[i].second.first->index + 1]++;
+    }
+    for(size_t c = 0; c < chip_count; c++)
+        inputs_start[c + 1] += inputs_start[c];
 
-void CircuitBuilder::makeAllConnections()
-{
-    // Delete all chips w/ unconnected outputs
-    bool removed;
-    do 
-    { 
-        removed = false;
-        for(std::vector<Chip*>::iterator it = chips.begin(); it != chips.end(); ++it)
+    std::vector<uint32_t> inputs(connection_count), next_input(inputs_start.begin(), inputs_start.end() - 1);
+    for(size_t i = 0; i < connection_count; i++)
+        inputs[next_input[connection_list_in[i].second.first->index]++] = i;
+
+    // Custom chips are kept, they can have effects other than their outputs
+    std::vector<Chip*> unused;
+    for(Chip* c : chips)
+        if(c->type != CUSTOM_CHIP && fanout_count[c->index] == 0)
+            unused.push_back(c);
+
+    std::vector<bool> removed(chip_count, false), disconnected(connection_count, false);
+    for(size_t n = 0; n < unused.size(); n++)
+    {
+        Chip* c = unused[n];
+        printf("Removing unused chip %s\n", getOutputInfo(c).c_str());
+        removed[c->index] = true;
+
+        for(uint32_t k = inputs_start[c->index]; k < inputs_start[c->index + 1]; k++)
         {
-            // Skip custom chips
-            if((*it)->type == CUSTOM_CHIP) continue;
-            
-            bool found = false;
-            for(std::vector<Connection>::iterator it2 = connection_list_out.begin(); it2 != connection_list_out.end(); ++it2)
-                if(*it == it2->second.first)
-                {
-                    found = true;
-                    break;
-                }
-    
-            if(!found)
-            {
-                printf("Removing unused chip %s\n", getOutputInfo(*it).c_str());
-                removed = true;
-                
-                // Remove all connections to this chip
-                for(int i = 0; i < connection_list_in.size(); i++)
-                    if(*it == connection_list_in[i].second.first)
-                    {
-                        connection_list_in.erase(connection_list_in.begin() + i);
-                        connection_list_out.erase(connection_list_out.begin() + i);
-                        i--;
-                    }
-                
-                if((*it)->type == BASIC_CHIP)
-                    delete[] (*it)->lut;
- 
-                delete *it;
-                it = chips.erase(it) - 1;
-            }
+            uint32_t i = inputs[k];
+            disconnected[i] = true;
+
+            Chip* driver = connection_list_out[i].second.first;
+            if(--fanout_count[driver->index] == 0 && driver->type != CUSTOM_CHIP)
+                unused.push_back(driver);
         }
-    } while(removed);
+    }
+
+    // Compact, keeping the order of what's left
+    size_t kept = 0;
+    for(size_t i = 0; i < connection_count; i++)
+        if(!disconnected[i])
+        {
+            connection_list_out[kept] = connection_list_out[i];
+            connection_list_in[kept] = connection_list_in[i];
+            kept++;
+        }
+    connection_list_out.resize(kept);
+    connection_list_in.resize(kept);
+
+    chips.erase(std::remove_if(chips.begin(), chips.end(), [&](const Chip* c) { return removed[c->index]; }), chips.end());
 
+    for(Chip* c : unused)
+        delete c;
+
+    return unused.size();
+}
+
+void CircuitBuilder::makeAllConnections()
+{
     // Make all connections
     for(int i = 0; i < connection_list_out.size(); i++)
     {
@@ -401,90 +667,532 @@ void CircuitBuilder::makeAllConnections()
         const ChipDesc* desc = connection_list_in[i].second.second;
         uint8_t pin          = connection_list_in[i].first;
         
-        c_out->connect(c_in, desc, pin);
+        connect(c_out, c_in, desc, pin);
 
-        if(c_out->output_links.size() > 64) 
+        if(outputLinks(c_out).size() > 64) 
         {
             std::string name = getOutputInfo(c_out);
 
             if(name != "_VCC.1" && name != "_GND.1")
-                printf("ERROR: Maximum output connection limit reached, chip:%s, cout:%lu\n", name.c_str(), c_out->output_links.size());
+                printf("ERROR: Maximum output connection limit reached, chip:%s, cout:%lu\n", name.c_str(), outputLinks(c_out).size());
         }
     }
 
 }
 
+void CircuitBuilder::connect(Chip* out, Chip* in, const ChipDesc* desc, uint8_t pin)
+{
+    std::vector<ChipLink>& links = outputLinks(out);
+
+    for(int i = 0; desc->input_pins[i]; i++)
+        if(desc->input_pins[i] == pin)
+        {
+			// If output links already contains a link to this chip,
+            // OR with its mask, otherwise add new link
+            int x;
+            for(x = 0; x < links.size(); x++)
+                if(links[x].chip == in) break;
+
+            if(x != links.size())
+            {
+                links[x].mask |= (1 << i);
+            }
+            else
+            {
+                links.push_back(ChipLink(in, 1 << i));
+                out->active_outputs |= (1ull << x);
+            }
+
+            // Add event bit to mask if this is an event pin
+            for(int j = 0; desc->event_pins[j]; j++)
+                if(desc->event_pins[j] == pin)
+                    links[x].mask |= (1 << (in->input_links.size() + j));
+
+            // Don't connect deoptimizer to input
+            if(out->type != CUSTOM_CHIP || out->custom_update != deoptimize)
+                in->input_links[i] = ChipLink(out, 1ull << x);
+
+            return;
+        }
+}
+
+void CircuitBuilder::freezeFanout()
+{
+    sources.resize(chips.size());
+    for(uint32_t i = 0; i < chips.size(); i++)
+    {
+        sources[i] = chips[i]->index;
+        chips[i]->index = i;
+    }
+
+    // Names of chips built from an image were kept as they were created
+    if(!image)
+    {
+        std::vector<std::string>& table_names = circuit->tables->chip_names;
+        table_names.clear();
+        circuit->tables->chip_hinted.clear();
+        circuit->tables->chip_first_input.clear();
+        for(uint32_t i = 0; i < chips.size(); i++)
+        {
+            table_names.push_back(names[chip_names[sources[i]]] + "." + std::to_string(int(chip_descs[sources[i]]->output_pin)));
+            circuit->tables->chip_hinted.push_back(chip_hinted[sources[i]]);
+            circuit->tables->chip_first_input.push_back(chip_descs[sources[i]]->input_pins[0]);
+        }
+    }
+
+    // Rows in chip order, the links are dropped once packed
+    size_t total = 0;
+    for(uint32_t source : sources)
+        total += output_links[source].size();
+
+    std::vector<FanoutLink>& fanout = circuit->tables->fanout;
+    fanout.clear();
+    fanout.reserve(total);
+
+    for(uint32_t i = 0; i < chips.size(); i++)
+    {
+        const std::vector<ChipLink>& links = output_links[sources[i]];
+
+        // Array is reserved and won't reallocate, the row can be handed out now
+        chips[i]->fanout = fanout.data() + fanout.size();
+        chips[i]->output_count = links.size();
+        for(const ChipLink& cl : links)
+            fanout.push_back(FanoutLink(cl.chip->index, uint32_t(cl.mask)));
+    }
+
+    output_links.clear();
+}
+
+static uint32_t count_chips(const ChipDesc* chip_desc)
+{
+    uint32_t count = 0;
+    for(const ChipDesc* d = chip_desc; !d->endOfDesc(); d++) count++;
+    return count;
+}
+
+// Builds from img if it has as many chips before pruning as desc creates
+bool CircuitBuilder::useImage(const NetlistImage* img, const CircuitDesc* desc)
+{
+    if(img == NULL) return false;
+
+    uint32_t count = 3 + count_chips(chip_VIDEO) + count_chips(chip_AUDIO);
+    for(const ChipInstance& instance : desc->get_chips())
+        count += count_chips(instance.chip);
+
+    for(const SubcircuitDesc& d : desc->get_sub_circuits())
+        for(const ChipInstance& instance : d.desc()->get_chips())
+            count += count_chips(instance.chip);
+
+    if(count != img->header().source_count) return false;
+
+    image = img;
+    return true;
+}
+
+void CircuitBuilder::linkImage()
+{
+    const NetlistImage::LinkRecord* link = image->links();
+    for(uint32_t i = 0; i < chips.size(); i++)
+    {
+        const NetlistImage::ChipRecord& r = image->chips()[i];
+        Chip* c = chips[i];
+
+        c->active_outputs = r.active_outputs;
+
+        std::vector<ChipLink>& outputs = outputLinks(c);
+        outputs.reserve(r.output_count);
+        for(uint32_t j = 0; j < r.output_count; j++, link++)
+            outputs.push_back(ChipLink(link->chip == NetlistImage::NO_CHIP ? NULL : chips[link->chip], link->mask));
+
+        for(uint32_t j = 0; j < r.input_count; j++, link++)
+            if(j < c->input_links.size())
+                c->input_links[j] = ChipLink(link->chip == NetlistImage::NO_CHIP ? NULL : chips[link->chip], link->mask);
+    }
+}
+
+// Image of the circuit as built, call once fan-out is frozen
+bool CircuitBuilder::writeImage(const std::string& path, const char* game, unsigned removed)
+{
+    NetlistImage::Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, NetlistImage::MAGIC, sizeof(h.magic));
+    h.version = NetlistImage::VERSION;
+    h.chip_count = chips.size();
+    h.source_count = chip_names.size();
+    h.removed = removed;
+    h.stamp = NetlistImage::stamp();
+    strncpy(h.game, game, sizeof(h.game) - 1);
+
+    std::vector<NetlistImage::ChipRecord> records(chips.size());
+    std::vector<NetlistImage::LinkRecord> links;
+    std::vector<uint32_t> luts;
+    std::unordered_map<const uint32_t*, uint32_t> lut_offsets; // Shared LUTs are stored once
+
+    for(uint32_t i = 0; i < chips.size(); i++)
+    {
+        const Chip* c = chips[i];
+        NetlistImage::ChipRecord& r = records[i];
+        memset(&r, 0, sizeof(r));
+
+        r.source = sources[i];
+        r.output_count = c->output_count;
+        r.input_count = c->input_links.size();
+        r.active_outputs = c->active_outputs;
+
+        int lut_size = LutPool::lutSize(chip_descs[sources[i]]);
+        if(lut_size > 6)
+        {
+            auto inserted = lut_offsets.insert(std::make_pair(c->lut, uint32_t(luts.size())));
+            if(inserted.second)
+                luts.insert(luts.end(), c->lut, c->lut + (1 << (lut_size-5)));
+            r.lut = inserted.first->second;
+        }
+        else if(lut_size > 0)
+            r.lut = c->lut_data;
+
+        for(uint32_t j = 0; j < c->output_count; j++)
+        {
+            NetlistImage::LinkRecord l = { c->fanout[j].chip, 0, c->fanout[j].mask };
+            links.push_back(l);
+        }
+
+        for(const ChipLink& cl : c->input_links)
+        {
+            NetlistImage::LinkRecord l = { cl.chip ? cl.chip->index : NetlistImage::NO_CHIP, 0, cl.mask };
+            links.push_back(l);
+        }
+    }
+
+    h.link_count = links.size();
+    h.lut_words = luts.size();
+
+    return NetlistImage::write(path, h, records.data(), links.data(), luts.data());
+}
+
 Circuit::~Circuit()
 {
     for(std::vector<Chip*>::iterator it = chips.begin(); it != chips.end(); ++it)
+        delete *it;
+
+    for(const CustomDataInstance& c : custom_data_copies)
+        c.copier->destroy(c.copy);
+}
+
+Circuit* Circuit::fork(const Settings& s, Input& i, Video& v, Audio& a)
+{
+    if(!settings.copy_custom_data) return nullptr;
+
+    return new Circuit(*this, s, i, v, a);
+}
+
+Circuit::Circuit(Circuit& parent, const Settings& s, Input& i, Video& v, Audio& a)
+  : settings(s)
+  , game_config(parent.game_config)
+  , input(i)
+  , video(v)
+  , audio(a)
+  , tables(parent.tables)
+  , global_time(parent.global_time)
+  , queue_type(parent.queue_type)
+  , event_count(parent.event_count)
+  , speculative(false)
+  , recorder()
+  , last_frame_count(parent.last_frame_count)
+  , profile(nullptr)
+  , build_times()
+{
+    // Private descriptors first, the chips are pointed at them
+    std::vector<const void*> parent_copies;
+    for(const CustomDataInstance& c : parent.custom_data_copies)
     {
-        if((*it)->type == BASIC_CHIP)
-            delete[] (*it)->lut;
+        CustomDataInstance copy = { c.original, c.copier->clone(c.copy), c.copier };
+        custom_data_copies.push_back(copy);
+        parent_copies.push_back(c.copy);
+    }
+    relinkCustomData(parent_copies);
 
-        delete *it;
+    for(const CustomDataState& c : parent.custom_data_state)
+    {
+        CustomDataState state = { forkCustomData(parent, c.data), c.copier };
+        custom_data_state.push_back(state);
+    }
+
+    chips.reserve(parent.chips.size());
+    for(const Chip* c : parent.chips)
+    {
+        chips.push_back(new Chip(*c, this));
+        chips.back()->custom_data = forkCustomData(parent, c->custom_data);
+    }
+
+    for(size_t n = 0; n < chips.size(); n++)
+        chips[n]->fork_links(*parent.chips[n]);
+
+    auto chip = [this](Chip* c) { return chips[c->index]; };
+
+    if(queue_type == Settings::CALENDAR_QUEUE)
+    {
+        calendar_queue = parent.calendar_queue;
+        calendar_queue.remap(chip);
+    }
+    else
+    {
+        heap_queue = parent.heap_queue;
+        heap_queue.remap(chip);
     }
+
+    // Video state goes through its serializer, which knows the derived class
+    video.desc = parent.video.desc;
+    nall::serializer counter;
+    parent.video.serialize(counter);
+    nall::serializer saved(counter.size());
+    parent.video.serialize(saved);
+    nall::serializer loaded(saved.data(), saved.size());
+    video.serialize(loaded);
+
+    if(&audio != &parent.audio)
+        audio.audio_fork(this, parent.audio);
 }
 
-uint64_t Circuit::queue_push(Chip* chip, uint64_t delay)
+// This circuit's counterpart of data, a custom_data pointer of parent
+void* Circuit::forkCustomData(const Circuit& parent, void* data) const
 {
-    int i;
-	QueueEntry qe(global_time + delay, chip);
+    if(data == &parent.video) return &video;
+    if(data == &parent.audio) return &audio;
 
-    queue_size++;
+    for(size_t n = 0; n < custom_data_copies.size(); n++)
+        if(parent.custom_data_copies[n].copy == data) return custom_data_copies[n].copy;
 
-    for(i = queue_size; i > 1 && queue[i >> 1].time > qe.time; i >>= 1)
-        queue[i] = queue[i >> 1];
+    return data;
+}
 
-    queue[i] = qe;
+void* Circuit::copyCustomData(const void* original, const CustomDataCopier* copier)
+{
+    // Chips sharing a descriptor keep sharing it within this circuit
+    for(const CustomDataInstance& c : custom_data_copies)
+        if(c.original == original) return c.copy;
 
-	return qe.time;
+    CustomDataInstance c = { original, copier->clone(original), copier };
+    custom_data_copies.push_back(c);
+    return c.copy;
 }
 
-
-void Circuit::queue_pop()
+// Copies of descriptors pointing at other descriptors (e.g. a paddle desc at its
+// 555 desc) were cloned pointing into from[n], each relink() moves them to the
+// same place in copy n
+void Circuit::relinkCustomData(const std::vector<const void*>& from)
 {
-    QueueEntry qe = queue[queue_size];
+    class Links : public CustomDataLinks
+    {
+    public:
+        struct Range
+        {
+            uintptr_t begin, end;
+            char* to;
 
-	int i = 1;
-    queue_size--;
+            bool operator<(const Range& r) const { return begin < r.begin; }
+        };
+        std::vector<Range> ranges; // Sorted by begin
 
-    while((i << 1) < (queue_size + 1))
+        // Anything outside from stays as it is
+        void* find(const void* p) const
+        {
+            Range key = { uintptr_t(p), 0, NULL };
+            auto it = std::upper_bound(ranges.begin(), ranges.end(), key);
+            if(it == ranges.begin() || uintptr_t(p) >= (--it)->end) return (void*)p;
+
+            return it->to + (uintptr_t(p) - it->begin);
+        }
+    } links;
+
+    for(size_t n = 0; n < custom_data_copies.size(); n++)
     {
-        int child = (i << 1);
+        const CustomDataInstance& c = custom_data_copies[n];
+        Links::Range r = { uintptr_t(from[n]), uintptr_t(from[n]) + c.copier->size, (char*)c.copy };
+        links.ranges.push_back(r);
+    }
+    std::sort(links.ranges.begin(), links.ranges.end());
 
-        if(child + 1 < queue_size + 1 && queue[child + 1].time < queue[child].time)
-            child++;
+    for(const CustomDataInstance& c : custom_data_copies)
+        c.copier->relink(c.copy, links);
+}
 
-        if(qe.time <= queue[child].time)
-            break;
+void Circuit::setProfiling(bool on)
+{
+    if(on && !profiler) profiler.reset(new ChipProfiler(chips.size()));
+    profile = on ? profiler->data() : nullptr;
+}
+
+void Circuit::reportOptimizerDecisions(FILE* f, const char* game) const
+{
+    const std::vector<std::string>& names = tables->chip_names;
+
+    fprintf(f, "Adaptive optimization of %s: %u decisions\n", game, unsigned(optimizer_decisions.size()));
+    for(const OptimizerDecision& d : optimizer_decisions)
+    {
+        fprintf(f, "%12.6f s %-20s %s", d.time * timescale, d.chip < names.size() ? names[d.chip].c_str() : "?",
+                d.disabled ? "disabled" : "enabled");
+        if(d.disabled)
+            fprintf(f, ", %llu steps for %llu events saved", (unsigned long long)d.cost, (unsigned long long)d.saving);
+        fprintf(f, "\n");
+    }
 
-        queue[i] = queue[child];
-        i = child;
+    // DISABLE_OPTIMIZATION attaches to an input pin, names end in the output pin
+    bool header = false;
+    for(const Chip* chip : chips)
+    {
+        if(!chip->optimization_disabled || chip->deoptimizations == 0 || chip->index >= names.size()) continue;
+
+        const std::string& name = names[chip->index];
+        if(!header) fprintf(f, "Still disabled, as netlist entries:\n");
+        fprintf(f, "    DISABLE_OPTIMIZATION(\"%s\", %d)\n", name.substr(0, name.rfind('.')).c_str(),
+                int(tables->chip_first_input[chip->index]));
+        header = true;
     }
+}
+
+void* Circuit::getCustomData(const void* original) const
+{
+    for(const CustomDataInstance& c : custom_data_copies)
+        if(c.original == original) return c.copy;
+
+    return (void*)original;
+}
+
+static const uint32_t STATE_MAGIC = 0x32545344; // "DST2"
+static const unsigned STATE_HEADER_SIZE = 6 * sizeof(uint32_t);
+
+nall::serializer Circuit::saveState()
+{
+    nall::serializer counter;
+    serialize(counter);
+
+    nall::serializer s(counter.size());
+    serialize(s);
+    return s;
+}
+
+bool Circuit::loadState(const uint8_t* data, unsigned size)
+{
+    if(size < STATE_HEADER_SIZE) return false;
+
+    nall::serializer s(data, size);
+    return serialize(s);
+}
+
+bool Circuit::serialize(nall::serializer& s)
+{
+    const bool load = s.mode() == nall::serializer::Load;
+
+    // Header, checked before anything is restored
+    uint32_t magic = STATE_MAGIC, size = s.capacity(), chip_count = chips.size();
+    uint32_t link_count = tables->fanout.size(), queue = queue_type, data_count = custom_data_state.size();
+    s.integer(magic);
+    s.integer(size);
+    s.integer(chip_count);
+    s.integer(link_count);
+    s.integer(queue);
+    s.integer(data_count);
+
+    if(load && (magic != STATE_MAGIC || size != s.capacity() || chip_count != chips.size() ||
+                link_count != tables->fanout.size() || queue != queue_type || data_count != custom_data_state.size()))
+        return false;
+
+    s.integer(global_time);
+    s.integer(event_count);
+    s.integer(last_frame_count);
+
+    // Queued chips are saved by index
+    auto chip = [this](nall::serializer& s, Chip*& c)
+    {
+        uint32_t i = (s.mode() == nall::serializer::Load) ? 0 : c->index;
+        s.integer(i);
+        if(s.mode() == nall::serializer::Load) c = chips[i];
+    };
+
+    if(queue_type == Settings::CALENDAR_QUEUE)
+        calendar_queue.serialize(s, chip);
+    else
+        heap_queue.serialize(s, chip);
+
+    for(Chip* c : chips) c->serialize(s);
+    for(Chip* c : chips) c->serialize_activation_cycles(s);
+
+    // Descs holding pointers save only their state, see CustomDataCopy::serialize()
+    for(const CustomDataState& c : custom_data_state)
+        c.copier->serialize(c.data, s);
+
+    video.serialize(s);
+
+    if(load) touched_chips.clear();
+    return true;
+}
+
+uint64_t Circuit::queue_push(Chip* chip, uint64_t delay)
+{
+    uint64_t time = global_time + delay;
+
+    if(queue_type == Settings::CALENDAR_QUEUE)
+        calendar_queue.push(time, chip);
+    else
+        heap_queue.push(time, chip);
+
+    PROFILE_PUSH(this, chip, queue_type == Settings::CALENDAR_QUEUE ? calendar_queue.size() : heap_queue.size());
 
-    queue[i] = qe;
+	return time;
+}
+
+void Circuit::queue_pop()
+{
+    if(queue_type == Settings::CALENDAR_QUEUE)
+        calendar_queue.pop();
+    else
+        heap_queue.pop();
 }
 
 void Circuit::run(int64_t run_time)
 {
+    if(queue_type == Settings::CALENDAR_QUEUE)
+        run_queue<CalendarQueue, false>(calendar_queue, run_time);
+    else
+        run_queue<HeapQueue, false>(heap_queue, run_time);
+}
+
+bool Circuit::run_frame(int64_t max_time)
+{
+    if(queue_type == Settings::CALENDAR_QUEUE)
+        return run_queue<CalendarQueue, true>(calendar_queue, max_time);
+    else
+        return run_queue<HeapQueue, true>(heap_queue, max_time);
+}
+
+template <class Q, bool STOP_AT_FRAME>
+bool Circuit::run_queue(Q& q, int64_t run_time)
+{
+    const uint32_t start_frame = video.frame_count;
+
     while(run_time > 0)
     {
-        if(queue_size)
+        if(!q.empty())
         {
-            run_time -= queue[1].time - global_time;
-            global_time = queue[1].time;
+            run_time -= q.top().time - global_time;
+            global_time = q.top().time;
         }
         else
         {
             global_time += run_time;
-            return;
+            return false;
         }
 
-        if(global_time == queue[1].chip->pending_event)
+        // Events pushed by update_output are never earlier than the top entry,
+        // so the top is still the same entry when it's popped
+        if(global_time == q.top().chip->pending_event)
         {
-            queue[1].chip->update_output();
+            q.top().chip->update_output();
         }
-        queue_pop();
+        else
+            PROFILE_COUNT(this, q.top().chip, stale_pops);
+        q.pop();
+        event_count++;
 
         /*-------------------------------------------------
          *  State‑dump sampling (optional, zero‑cost if
@@ -494,8 +1202,10 @@ void Circuit::run(int64_t run_time)
         {
             if(recorder->mode() == SampleMode::Tick)
             {
-                /* cycle‑accurate: every iteration */
-                recorder->sample(global_time, chips);
+                /* cycle‑accurate: every iteration, only chips
+                 * touched by this event can have changed */
+                recorder->sample(global_time, chips, touched_chips);
+                touched_chips.clear();
             }
             else  /* SampleMode::FrameEdge */
             {
@@ -503,8 +1213,14 @@ void Circuit::run(int64_t run_time)
                 if(f_now != last_frame_count)
                     recorder->sample(global_time, chips);
                 last_frame_count = f_now;
+                touched_chips.clear();
             }
         }
+
+        if(STOP_AT_FRAME && video.frame_count != start_frame)
+            return true;
     }
+
+    return false;
 }
 
@@ -5,6 +5,8 @@
 #include <vector>
 #include <string>        // ← needed for std::string
 #include <memory>        // ← needed for std::unique_ptr
+#include <cstring>
+#include <nall/serializer.hpp>
 
 #include "settings.h"
 #include "game_config.h"
@@ -16,17 +18,21 @@
 #include "chips/input.h"
 
 #include "state_dump.h"  // ← new: state‑dump support
-
-#define MAX_QUEUE_SIZE 4096
+#include "event_queue.h"
+#include "input_journal.h"
+#include "chip_profiler.h"
 
 class CircuitDesc;
+struct CustomDataCopier;
 
-struct QueueEntry
+// Derived from the netlist when the circuit is built and never changed
+// afterwards, so forks of a circuit share one copy
+struct NetlistTables
 {
-    uint64_t time;
-    Chip*    chip;
-
-    QueueEntry(uint64_t t = 0, Chip* c = nullptr) : time(t), chip(c) {}
+    std::vector<FanoutLink> fanout; // All output links in one array, grouped by source chip
+    std::vector<std::string> chip_names; // Instance name and output pin ("F8.12") by chip, for reports
+    std::vector<bool> chip_hinted;       // Sized by the game's hints (HintTable), not a special, video or audio chip
+    std::vector<uint8_t> chip_first_input; // First input pin by chip, where DISABLE_OPTIMIZATION can attach
 };
 
 class Circuit
@@ -34,38 +40,139 @@ class Circuit
 public:
     /* existing public members */
     std::vector<Chip*> chips;
+    std::shared_ptr<NetlistTables> tables;
     uint64_t           global_time;
 
     const Settings& settings;
     GameConfig      game_config;
     Input&          input;
     Video&          video;
-    Audio           audio;
+    Audio&          audio;
     RealTimeClock   rtc;
 
-    int         queue_size;
-    QueueEntry  queue[MAX_QUEUE_SIZE];
+    unsigned       queue_type;  // Settings::EventQueue
+    HeapQueue      heap_queue;
+    CalendarQueue  calendar_queue;
+    uint64_t       event_count; // Events processed by run()
+    bool           speculative; // Running frames that will be rolled back (RunAhead): no throttling or sound
+
+    // Private copies of chip custom_data, when Settings::copy_custom_data is set
+    struct CustomDataInstance
+    {
+        const void* original;
+        void* copy;
+        const CustomDataCopier* copier;
+    };
+    std::vector<CustomDataInstance> custom_data_copies;
+
+    // custom_data used by custom chips, saved with the circuit state
+    struct CustomDataState
+    {
+        void* data;
+        const CustomDataCopier* copier;
+    };
+    std::vector<CustomDataState> custom_data_state;
 
     /* new recorder members */
     std::unique_ptr<StateRecorder> recorder;   // owns the dump file
     uint32_t                        last_frame_count = 0;
+    std::vector<uint32_t>           touched_chips; // Updated or woken up since the last sample, only these
+                                                   // can have changed output (filled while recording)
+    std::unique_ptr<InputJournal>   journal;       // Records or replays what the input chips read
+    std::unique_ptr<ChipProfiler>   profiler;      // Counters kept by setProfiling(), not copied to forks
+    ChipProfiler::Counters*         profile;       // profiler's counters while counting, NULL otherwise
+
+    // Chips the cycle optimizer was disabled or enabled again for at run time
+    // (Settings::adaptive_optimization), in order. Not part of the state, not copied to forks.
+    struct OptimizerDecision
+    {
+        uint32_t chip;
+        uint64_t time;
+        bool     disabled;
+        uint64_t cost, saving; // Optimizer loop steps and events saved in the review that disabled it
+    };
+    std::vector<OptimizerDecision> optimizer_decisions;
+
+    // Time spent building the circuit by step, in seconds (dice_headless --bench-build).
+    // A fork isn't built, its times are 0.
+    struct BuildTimes
+    {
+        double   chips;       // Creating chips, LUTs included
+        double   connections; // Resolving the netlist's connections
+        double   pruning;     // Removing chips with unconnected outputs
+        double   linking;     // Linking chips, grounding open inputs, packing fan-out
+        double   init;        // Audio setup and chip initialization
+        double   image;       // Writing the netlist image, after building from scratch
+        double   total;
+        unsigned removed;     // Chips pruned
+        bool     from_image;  // Chips and links came from the netlist image, no connections or pruning
+        unsigned settle_evaluations; // Chip evaluations to settle power-on levels, see settle()
+        unsigned unsettled;   // Chips still changing when settle() gave up on them
+    } build_times;
 
     /* updated constructor */
     Circuit(const Settings&  s,
             Input&           i,
             Video&           v,
+            Audio&           a,
             const CircuitDesc* desc,
             const char*      name,
             const std::string& dump_path = "",
-            SampleMode        smode      = SampleMode::Tick);
+            SampleMode        smode      = SampleMode::Tick,
+            DumpFormat        dformat    = DumpFormat::Raw);
 
     ~Circuit();
 
+    // Independent copy of the running circuit, e.g. to try an action a few frames
+    // ahead and throw it away. Only mutable state is copied: chip state, optimizer
+    // cycles, the event queue, private custom_data copies and the video state.
+    // LUTs and fan-out are shared. v must be the same kind of video as this
+    // circuit's, a sends audio on its own (an AudioNull may be shared). The fork
+    // doesn't record state dumps. This circuit must have been built with
+    // Settings::copy_custom_data, without it both would run on the netlist's
+    // static descriptors (555s, RAMs, paddles...): NULL then.
+    Circuit* fork(const Settings& s, Input& i, Video& v, Audio& a);
+
     uint64_t queue_push(Chip* chip, uint64_t delay);
     void     queue_pop();
     void     run(int64_t time);
+    bool     run_frame(int64_t max_time); // Run until the next VBLANK, false if max_time passed first
+
+    // Starts or stops counting events per chip. Counters accumulate until
+    // profiler->clear(), profiler->report() ranks the chips.
+    void     setProfiling(bool on);
+
+    // optimizer_decisions with instance names, then DISABLE_OPTIMIZATION netlist
+    // entries for the chips the optimizer is still disabled for
+    void     reportOptimizerDecisions(FILE* f, const char* game) const;
+
+    // This circuit's copy of a descriptor passed as custom_data, or original if it isn't copied
+    void*    getCustomData(const void* original) const;
+
+    // Snapshot of everything that changes while running: time, event queue, chip
+    // inputs, outputs and pending events, optimizer cycles, video scan position and
+    // mutable custom_data (RAMs, 555 and RC filter state, paddle positions).
+    // It can be loaded into this circuit or another one built from the same game
+    // with the same settings, by the same executable, also in another process.
+    nall::serializer saveState();
+    bool     loadState(const uint8_t* data, unsigned size); // false if the state is not from this game
+    bool     loadState(const nall::serializer& s) { return loadState(s.data(), s.size()); }
 
     static const double timescale;
+
+private:
+    template <class Q, bool STOP_AT_FRAME> bool run_queue(Q& q, int64_t time);
+
+    Circuit(Circuit& parent, const Settings& s, Input& i, Video& v, Audio& a);
+
+    friend class CircuitBuilder;
+    void*    copyCustomData(const void* original, const CustomDataCopier* copier);
+    void     relinkCustomData(const std::vector<const void*>& from);
+    void*    forkCustomData(const Circuit& parent, void* data) const;
+    bool     serialize(nall::serializer& s);
+    void     settle();
 };
 
+inline Chip* Chip::output_chip(int n) const { return circuit->chips[fanout[n].chip]; }
+
 #endif
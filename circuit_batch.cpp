@@ -0,0 +1,88 @@
+#include "circuit_batch.h"
+
+const double CircuitBatch::MAX_FRAME_TIME = 0.1; // 100 ms
+
+CircuitBatch::CircuitBatch(const CircuitDesc* desc, const char* name, unsigned num_instances, unsigned threads,
+                           unsigned width, unsigned height, VideoFramebuffer::Format format) :
+    generation(0), busy_workers(0), quit(false), next_instance(0), step_frames(0)
+{
+    settings.throttle = false;
+    settings.copy_custom_data = true;
+
+    // Built one at a time, netlist construction and ROM loading aren't thread safe
+    for(unsigned i = 0; i < num_instances; i++)
+    {
+        Instance* inst = new Instance(width, height, format);
+        inst->circuit = new Circuit(settings, inst->input, inst->video, inst->audio, desc, name);
+        instances.push_back(inst);
+    }
+
+    if(threads == 0) threads = std::thread::hardware_concurrency();
+    if(threads > num_instances) threads = num_instances;
+
+    // The calling thread does its share of the work too
+    for(unsigned i = 1; i < threads; i++)
+        workers.push_back(std::thread(&CircuitBatch::worker, this));
+}
+
+CircuitBatch::~CircuitBatch()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    start_cond.notify_all();
+
+    for(std::thread& t : workers) t.join();
+
+    for(Instance* inst : instances)
+    {
+        delete inst->circuit;
+        delete inst;
+    }
+}
+
+void CircuitBatch::step(unsigned frames)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        step_frames = frames;
+        next_instance = 0;
+        busy_workers = workers.size();
+        generation++;
+    }
+    start_cond.notify_all();
+
+    runInstances();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cond.wait(lock, [this]{ return busy_workers == 0; });
+}
+
+void CircuitBatch::worker()
+{
+    uint64_t seen = 0;
+
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_cond.wait(lock, [&]{ return quit || generation != seen; });
+            if(quit) return;
+            seen = generation;
+        }
+
+        runInstances();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if(--busy_workers == 0) done_cond.notify_one();
+    }
+}
+
+void CircuitBatch::runInstances()
+{
+    // Instances are handed out one at a time, so uneven frames balance out
+    for(unsigned i = next_instance++; i < instances.size(); i = next_instance++)
+        for(unsigned f = 0; f < step_frames; f++)
+            instances[i]->circuit->run_frame(MAX_FRAME_TIME / Circuit::timescale);
+}
@@ -0,0 +1,64 @@
+#ifndef CIRCUIT_BATCH_H
+#define CIRCUIT_BATCH_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include "circuit.h"
+#include "chips/video_framebuffer.h"
+#include "chips/audio_null.h"
+#include "chips/input_null.h"
+
+// N isolated instances of one game, stepped in lockstep on a thread pool.
+// Each instance has its own Circuit with private custom_data copies,
+// its own framebuffer and null audio/input.
+class CircuitBatch
+{
+public:
+    struct Instance
+    {
+        InputNull        input;
+        VideoFramebuffer video;
+        AudioNull        audio;
+        Circuit*         circuit;
+
+        Instance(unsigned w, unsigned h, VideoFramebuffer::Format f) : video(w, h, f), circuit(nullptr) { }
+    };
+
+    // threads = 0 uses one thread per core
+    CircuitBatch(const CircuitDesc* desc, const char* name, unsigned instances, unsigned threads = 0,
+                 unsigned width = 320, unsigned height = 240, VideoFramebuffer::Format format = VideoFramebuffer::LUMA8);
+    ~CircuitBatch();
+
+    unsigned size() const { return instances.size(); }
+    unsigned threadCount() const { return workers.size() + 1; }
+    Instance& operator[](unsigned i) { return *instances[i]; }
+
+    // Advance every instance by the given number of frames (VBLANKs)
+    void step(unsigned frames = 1);
+
+    // Upper bound on emulated time per frame, for circuits that stop producing VBLANKs
+    static const double MAX_FRAME_TIME;
+
+private:
+    Settings settings;
+    std::vector<Instance*> instances;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable start_cond, done_cond;
+    uint64_t generation;
+    unsigned busy_workers;
+    bool quit;
+
+    std::atomic<unsigned> next_instance;
+    unsigned step_frames;
+
+    void worker();
+    void runInstances();
+};
+
+#endif
@@ -7,6 +7,9 @@
 #include "audio_desc.h"
 #include "input_desc.h"
 
+#include <type_traits>
+#include <nall/serializer.hpp>
+
 enum CircuitDescType : uint8_t
 {
     CHIP_INST = 0,
@@ -19,11 +22,75 @@ enum CircuitDescType : uint8_t
     SUB_CIRCUIT
 };
 
+// How to duplicate a chip's custom_data, so each Circuit can get a private
+// copy of mutable descriptors (see Settings::copy_custom_data), and how to
+// save its runtime state (see Circuit::saveState)
+struct CustomDataCopier
+{
+    size_t size;
+    void* (*clone)(const void* p);
+    void (*destroy)(void* p);
+    void (*serialize)(void* p, nall::serializer& s);
+    void (*relink)(void* p, const CustomDataLinks& links); // Point a clone at the other clones
+};
+
+template<typename T> struct has_relink
+{
+    template<typename C> static char test(decltype(std::declval<C>().relink(std::declval<const CustomDataLinks&>()))*);
+    template<typename C> static long test(...);
+    static const bool value = sizeof(test<T>(0)) == sizeof(char);
+};
+
+template<typename T, bool COPYABLE = !std::is_const<T>::value &&
+                                     (std::is_copy_constructible<T>::value || std::is_array<T>::value)>
+struct CustomDataCopy
+{
+    typedef typename std::remove_all_extents<T>::type Element;
+
+    // Arrays (RAM contents) are plain bytes
+    static void* clone(const void* p) { return clone(p, std::is_array<T>()); }
+    static void* clone(const void* p, std::false_type) { return new T(*(const T*)p); }
+    static void* clone(const void* p, std::true_type) { return memcpy(new T, p, sizeof(T)); }
+
+    static void destroy(void* p) { destroy(p, std::is_array<T>()); }
+    static void destroy(void* p, std::false_type) { delete (T*)p; }
+    static void destroy(void* p, std::true_type) { delete[] (Element*)p; }
+
+    // Descriptors holding pointers or heap data provide serialize(),
+    // anything else is saved as raw bytes
+    static void serialize(void* p, nall::serializer& s) { serialize(p, s, std::integral_constant<bool, nall::has_serialize<T>::value>()); }
+    static void serialize(void* p, nall::serializer& s, std::true_type) { ((T*)p)->serialize(s); }
+    static void serialize(void* p, nall::serializer& s, std::false_type) { s.array((uint8_t*)p, sizeof(T)); }
+
+    static_assert(nall::has_serialize<T>::value || !std::is_polymorphic<T>::value,
+                  "Raw bytes of a polymorphic descriptor include its vtable, give it serialize()");
+    static_assert(nall::has_serialize<T>::value || !has_relink<T>::value,
+                  "Raw bytes of a descriptor with relink() include its pointers, give it serialize()");
+
+    // Descriptors pointing at other descriptors provide relink()
+    static void relink(void* p, const CustomDataLinks& links) { relink(p, links, std::integral_constant<bool, has_relink<T>::value>()); }
+    static void relink(void* p, const CustomDataLinks& links, std::true_type) { ((T*)p)->relink(links); }
+    static void relink(void* p, const CustomDataLinks& links, std::false_type) { }
+
+    static const CustomDataCopier copier;
+    static constexpr const CustomDataCopier* get() { return &copier; }
+};
+
+template<typename T, bool COPYABLE>
+const CustomDataCopier CustomDataCopy<T, COPYABLE>::copier = { sizeof(T), &clone, &destroy, &serialize, &relink };
+
+// Read-only or non-copyable data stays shared
+template<typename T> struct CustomDataCopy<T, false>
+{
+    static constexpr const CustomDataCopier* get() { return nullptr; }
+};
+
 struct ChipInstance
 {
     const char* name;
     const ChipDesc* chip;
 	uintptr_t custom_data;
+    const CustomDataCopier* copier;
 };
 
 struct ConnectionDesc
@@ -68,7 +135,7 @@ struct CircuitEntry
         const SubcircuitDesc sub_circuit;
         OptimizationHintDesc hint;        
 
-        constexpr U(const char* n, const ChipDesc* c, uintptr_t d) : instance({n, c, d}) { }
+        constexpr U(const char* n, const ChipDesc* c, uintptr_t d, const CustomDataCopier* cp = nullptr) : instance({n, c, d, cp}) { }
         constexpr U(const char* n1, uint8_t p1, const char* n2, uint8_t p2) : connection({n1, n2, p1, p2}) { }
         constexpr U(const char* n, const char* c, uint8_t p) : net({n, c, p}) { }
         constexpr U(const VideoDesc* v) : video(v) { }
@@ -80,7 +147,7 @@ struct CircuitEntry
     CircuitDescType type;
 
     constexpr CircuitEntry(const char* n, const ChipDesc* c) : type(CHIP_INST), u(n, c, 0) { }
-    template<typename T> constexpr CircuitEntry(const char* n, const ChipDesc* c, T* d) : type(CHIP_INST), u(n, c, (uintptr_t)d) { }
+    template<typename T> constexpr CircuitEntry(const char* n, const ChipDesc* c, T* d) : type(CHIP_INST), u(n, c, (uintptr_t)d, CustomDataCopy<T>::get()) { }
     constexpr CircuitEntry(const char* n, const ChipDesc* c, uintptr_t d) : type(CHIP_INST), u(n, c, d) { }
 	constexpr CircuitEntry(const char* n1, uint8_t p1, const char* n2, uint8_t p2) : type(CONNECTION), u(n1, p1, n2, p2) { }
     constexpr CircuitEntry(const char* n, const char* c, uint8_t p) : type(NET_LISTING), u(n, c, p) { }
@@ -114,6 +114,37 @@ public:
     const index& begin() const { return first; }
     const index& end() const { return next; }
 
+    // Save or restore positions and live slots with a nall::serializer, item(T&)
+    // handles one slot. Stale slots aren't read before they are pushed again.
+    template <class S, class F> void serialize(S& s, F item)
+    {
+        uint16_t f = first.idx, n = next.idx;
+        s.integer(f);
+        s.integer(n);
+        first.idx = f & first.mask;
+        next.idx = n & next.mask;
+
+        for(index i = first; i != next; ++i) item(queue[i.idx]);
+    }
+
+    template <class F> void for_each_slot(F item)
+    {
+        for(int i = 0; i <= first.mask; i++) item(queue[i]);
+    }
+
+    template <class S> void serialize(S& s) { serialize(s, [&s](T& x) { s(x); }); }
+
+    void rewind() { first.idx = next.idx = 0; }
+
+    // Positions and live slots of a queue of the same size
+    void copy_live(const cirque& c)
+    {
+        first.idx = c.first.idx;
+        next.idx = c.next.idx;
+
+        for(index i = first; i != next; ++i) queue[i.idx] = c.queue[i.idx];
+    }
+
     // Perform binary search for element.
     // Returns index that is less than or equal to the value being searched for,
     // but where index+1 is greater than the value (or non existant).
@@ -0,0 +1,65 @@
+/*--------------------------------------------------------------------
+    DICE 0.9a  –  dump_convert.cpp
+    Converts state dumps between the raw and delta formats
+--------------------------------------------------------------------*/
+
+#include "state_dump.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+
+static void usage()
+{
+    printf("usage: dice_dump_convert <in> <out> [-to raw|delta] [-chips N]\n");
+    printf("       Delta dumps are detected from their header. Raw dumps have none,\n");
+    printf("       so reading one needs -chips with the circuit's chip count.\n");
+    printf("       Default output is raw for delta input, delta for raw input.\n");
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 3)
+    {
+        usage();
+        return 1;
+    }
+
+    const char* to         = nullptr;
+    unsigned    chip_count = 0;
+
+    for(int i = 3; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "-to") == 0 && i+1 < argc)
+            to = argv[++i];
+        else if(strcmp(argv[i], "-chips") == 0 && i+1 < argc)
+            chip_count = atoi(argv[++i]);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    try
+    {
+        DumpFormat out_format;
+        if(to)
+            out_format = strcmp(to, "delta") == 0 ? DumpFormat::Delta : DumpFormat::Raw;
+        else
+            out_format = StateDumpReader(argv[1], chip_count ? chip_count : 1).format() == DumpFormat::Delta ?
+                         DumpFormat::Raw : DumpFormat::Delta;
+
+        uint64_t samples = convert_state_dump(argv[1], argv[2], out_format, chip_count);
+        printf("%s: %llu samples written as %s\n", argv[2], (unsigned long long)samples,
+               out_format == DumpFormat::Delta ? "delta" : "raw");
+    }
+    catch(const std::exception& e)
+    {
+        printf("%s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,220 @@
+#include <nall/platform.hpp>
+#include <nall/directory.hpp>
+
+#include "environment.h"
+#include "netlist_image.h"
+
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+const double Environment::MAX_FRAME_TIME = 0.1; // 100 ms
+
+Environment::Environment(const CircuitDesc* d, const char* n, unsigned w, unsigned h, VideoFramebuffer::Format f, unsigned warm) :
+    desc(d), name(n), width(w), height(h), format(f), warm_frames(warm), framebuffer(nullptr), circ(nullptr),
+    start_time(0), start_frame(0)
+{
+    settings.throttle = false;
+    settings.copy_custom_data = true;
+
+    setup_keys();
+    reset();
+}
+
+Environment::Environment(Environment& parent) :
+    desc(parent.desc), name(parent.name), width(parent.width), height(parent.height), format(parent.format),
+    warm_frames(parent.warm_frames), settings(parent.settings), framebuffer(new VideoFramebuffer(width, height, format)), circ(nullptr),
+    power_on(parent.power_on), start_time(parent.start_time), start_frame(parent.start_frame)
+{
+    setup_keys();
+    circ = parent.circ->fork(settings, input, *framebuffer, audio);
+}
+
+Environment::~Environment()
+{
+    delete circ;
+    delete framebuffer;
+}
+
+void Environment::setup_keys()
+{
+    const Settings::Input& in = settings.input;
+    button_keys =
+    {
+        &in.coin_start.coin1, &in.coin_start.coin2, &in.coin_start.start1, &in.coin_start.start2,
+        &in.joystick[0].up, &in.joystick[0].down, &in.joystick[0].left, &in.joystick[0].right,
+        &in.joystick[1].up, &in.joystick[1].down, &in.joystick[1].left, &in.joystick[1].right,
+        &in.buttons[0].button1, &in.buttons[0].button2, &in.buttons[0].button3,
+        &in.buttons[1].button1, &in.buttons[1].button2, &in.buttons[1].button3,
+        &in.buttons[2].button1, &in.buttons[2].button2,
+        &in.buttons[3].button1, &in.buttons[3].button2
+    };
+}
+
+Environment::Observation Environment::reset()
+{
+    input.clear();
+
+    // Built once, later resets restore the state captured at power-on
+    if(circ == nullptr)
+    {
+        framebuffer = new VideoFramebuffer(width, height, format);
+        circ = new Circuit(settings, input, *framebuffer, audio, desc, name);
+        if(warm_frames) warm_start();
+        power_on = std::make_shared<nall::serializer>(circ->saveState());
+    }
+    else circ->loadState(*power_on);
+
+    start_time = circ->global_time;
+    start_frame = framebuffer->frame_count;
+    return observe(false);
+}
+
+Environment* Environment::fork()
+{
+    return new Environment(*this);
+}
+
+// Cache file: "DICEWRM1", uint64 key, uint32 frames, uint32 state size, then
+// the Circuit::saveState() data
+struct WarmHeader
+{
+    char     magic[8];
+    uint64_t key;
+    uint32_t frames;
+    uint32_t size;
+};
+
+static const char WARM_MAGIC[8] = { 'D','I','C','E','W','R','M','1' };
+
+static void key_add(uint64_t& hash, const void* data, size_t size)
+{
+    // FNV-1a
+    const uint8_t* p = (const uint8_t*)data;
+    for(size_t i = 0; i < size; i++)
+        hash = (hash ^ p[i]) * 0x100000001b3ull;
+}
+
+// 0 if the build can't be identified, nothing is cached then
+uint64_t Environment::warm_key() const
+{
+    uint64_t build = NetlistImage::stamp();
+    if(build == 0) return 0;
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+    key_add(hash, &build, sizeof(build));
+    key_add(hash, name, strlen(name) + 1);
+
+    uint32_t values[] = { warm_frames, settings.event_queue, settings.copy_custom_data, settings.adaptive_optimization, width, height, uint32_t(format) };
+    key_add(hash, values, sizeof(values));
+
+    // Queue sizes are part of the state, they depend on the game's HintTable
+    for(const Chip* c : circ->chips)
+    {
+        uint32_t sizes[] = { c->first_output_event.getQueueSize(), uint32_t(c->allocated_sub_cycles.size()) };
+        key_add(hash, sizes, sizeof(sizes));
+    }
+
+    // DIP switches and potentiometers
+    const GameConfig& config = circ->game_config;
+    for(unsigned i = 0; i < config.list.size(); i++)
+    {
+        nall::string item = {config.list[i].name, "=", config.list[i].get()};
+        key_add(hash, item.data(), item.length() + 1);
+    }
+
+    return hash ? hash : 1;
+}
+
+void Environment::warm_start()
+{
+    uint64_t key = warm_key();
+
+    // Per executable, like netlist images: their keys differ
+    char file_name[160];
+    snprintf(file_name, sizeof(file_name), "%s.%s.%u.warm", name, NetlistImage::executable(), warm_frames);
+    nall::string dir = {nall::configpath(), "dice/warm/"};
+    std::string path = std::string(dir.data()) + file_name;
+
+    if(key)
+    {
+        FILE* f = fopen(path.c_str(), "rb");
+        if(f)
+        {
+            WarmHeader h;
+            std::vector<uint8_t> state;
+            bool ok = fread(&h, sizeof(h), 1, f) == 1 && memcmp(h.magic, WARM_MAGIC, sizeof(WARM_MAGIC)) == 0 &&
+                      h.key == key && h.frames == warm_frames;
+            if(ok)
+            {
+                state.resize(h.size);
+                ok = fread(state.data(), 1, h.size, f) == h.size;
+            }
+            fclose(f);
+
+            if(ok && circ->loadState(state.data(), state.size())) return;
+        }
+    }
+
+    // Boot with nothing pressed
+    input.clear();
+    for(unsigned i = 0; i < warm_frames; i++)
+        if(!circ->run_frame(MAX_FRAME_TIME / Circuit::timescale)) break;
+
+    if(key == 0) return;
+
+    nall::serializer s = circ->saveState();
+    WarmHeader h;
+    memcpy(h.magic, WARM_MAGIC, sizeof(WARM_MAGIC));
+    h.key = key;
+    h.frames = warm_frames;
+    h.size = s.size();
+
+    // Written aside and renamed, Environments in other processes may be reading it
+    nall::directory::create(dir);
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%d.tmp", int(getpid()));
+    std::string tmp_path = path + suffix;
+
+    FILE* f = fopen(tmp_path.c_str(), "wb");
+    if(f == nullptr) return;
+
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(s.data(), 1, s.size(), f) == s.size();
+    ok = fclose(f) == 0 && ok;
+    if(!ok || rename(tmp_path.c_str(), path.c_str()) != 0)
+        remove(tmp_path.c_str());
+}
+
+void Environment::checkpoint()
+{
+    power_on = std::make_shared<nall::serializer>(circ->saveState());
+}
+
+Environment::Observation Environment::step(const Action& action, unsigned frames)
+{
+    // Released first, several buttons can share a key assignment
+    input.clear();
+
+    for(unsigned p = 0; p < InputInjected::MAX_PADDLES; p++)
+        input.setPaddle(p, action.paddle[p]);
+
+    for(unsigned b = 0; b < Action::NUM_BUTTONS; b++)
+        if(action.buttons & (1u << b))
+            input.setKey(*button_keys[b], true);
+
+    bool timed_out = false;
+    for(unsigned i = 0; i < frames && !timed_out; i++)
+        timed_out = !circ->run_frame(MAX_FRAME_TIME / Circuit::timescale);
+
+    return observe(timed_out);
+}
+
+Environment::Observation Environment::observe(bool timed_out) const
+{
+    Observation obs;
+    obs.frame = framebuffer->frame();
+    obs.frame_count = framebuffer->frame_count - start_frame;
+    obs.time = circ->global_time - start_time;
+    obs.timed_out = timed_out;
+    return obs;
+}
@@ -0,0 +1,109 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include <cmath>
+#include <vector>
+
+#include "circuit.h"
+#include "chips/video_framebuffer.h"
+#include "chips/audio_null.h"
+#include "chips/input_injected.h"
+
+// Frame-stepped interface to one game for scripted play and agent training.
+// reset() starts the game from power-on, step() applies an action and runs
+// to the next VBLANK, returning the completed frame. The circuit is built by
+// the first reset(), later ones restore a snapshot instead of rebuilding.
+// Settings changed through config() take effect once the Environment is
+// recreated.
+//
+// With warm_frames, reset() starts that many frames after power-on (no input
+// pressed) instead, past the netlist settling and the attract mode starting.
+// The warm state is cached in the configuration directory, keyed by game,
+// frame count, DIP switch and potentiometer settings, event queue, frame
+// format and the executable and ROMs (NetlistImage::stamp()). Environments
+// created later load it instead of running the boot sequence, a key that
+// doesn't match runs it again and replaces the cache.
+class Environment
+{
+public:
+    struct Action
+    {
+        // Bit numbers in buttons. Each is looked up in the settings' key assignments.
+        enum Button
+        {
+            COIN1, COIN2, START1, START2,
+            JOY1_UP, JOY1_DOWN, JOY1_LEFT, JOY1_RIGHT,
+            JOY2_UP, JOY2_DOWN, JOY2_LEFT, JOY2_RIGHT,
+            P1_BUTTON1, P1_BUTTON2, P1_BUTTON3,
+            P2_BUTTON1, P2_BUTTON2, P2_BUTTON3,
+            P3_BUTTON1, P3_BUTTON2,
+            P4_BUTTON1, P4_BUTTON2,
+            NUM_BUTTONS
+        };
+
+        double paddle[InputInjected::MAX_PADDLES]; // 0.0 - 1.0, NaN leaves the paddle where it is
+        uint32_t buttons;                          // Held down for the whole step
+
+        Action() : paddle{NAN, NAN, NAN, NAN}, buttons(0) { }
+
+        Action& press(Button b) { buttons |= 1u << b; return *this; }
+    };
+
+    struct Observation
+    {
+        const uint8_t* frame;  // Last completed frame, valid until the next step() or reset()
+        uint32_t frame_count;  // Frames since the state reset() went back to
+        uint64_t time;         // Emulated time since that state, in Circuit time units
+        bool     timed_out;    // No VBLANK within MAX_FRAME_TIME, frame is stale
+    };
+
+    Environment(const CircuitDesc* desc, const char* name,
+                unsigned width = 320, unsigned height = 240, VideoFramebuffer::Format format = VideoFramebuffer::LUMA8,
+                unsigned warm_frames = 0);
+    ~Environment();
+
+    Observation reset();
+    Observation step(const Action& action, unsigned frames = 1);
+
+    // Copy of the game as it is now, for lookahead: step it with other actions and
+    // delete it. Only the running state is copied (see Circuit::fork()), reset()
+    // on the copy goes back to the shared power-on snapshot.
+    Environment* fork();
+
+    // Makes the current state the one reset() goes back to, e.g. once the game is
+    // past its power-on sequence. Forks made afterwards share it.
+    void checkpoint();
+
+    Circuit& circuit() { return *circ; }
+    VideoFramebuffer& video() { return *framebuffer; }
+    Settings& config() { return settings; }
+
+    // Upper bound on emulated time per frame, for circuits that stop producing VBLANKs
+    static const double MAX_FRAME_TIME;
+
+private:
+    const CircuitDesc* desc;
+    const char* name;
+    unsigned width, height;
+    VideoFramebuffer::Format format;
+    unsigned warm_frames;
+
+    Settings settings;
+    InputInjected input;
+    AudioNull audio;
+    VideoFramebuffer* framebuffer;
+    Circuit* circ;
+    std::shared_ptr<const nall::serializer> power_on;
+    uint64_t start_time;  // global_time and frame_count of the state reset() restored,
+    uint32_t start_frame; // observations count from there
+
+    std::vector<const KeyAssignment*> button_keys; // Indexed by Action::Button
+
+    Environment(Environment& parent);
+    void setup_keys();
+    void warm_start();
+    uint64_t warm_key() const;
+    Observation observe(bool timed_out) const;
+};
+
+#endif
@@ -0,0 +1,286 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include <stdint.h>
+#include <vector>
+
+class Chip;
+
+#define MAX_QUEUE_SIZE 4096
+
+struct QueueEntry
+{
+    uint64_t time;
+    Chip*    chip;
+
+    QueueEntry(uint64_t t = 0, Chip* c = nullptr) : time(t), chip(c) {}
+};
+
+// Binary min-heap over a fixed array, 1-based
+class HeapQueue
+{
+public:
+    int         queue_size;
+    QueueEntry  queue[MAX_QUEUE_SIZE];
+
+    HeapQueue() : queue_size(0) { }
+
+    bool empty() const { return queue_size == 0; }
+    int size() const { return queue_size; }
+    const QueueEntry& top() const { return queue[1]; }
+
+    void push(uint64_t time, Chip* chip)
+    {
+        int i;
+        QueueEntry qe(time, chip);
+
+        queue_size++;
+
+        for(i = queue_size; i > 1 && queue[i >> 1].time > qe.time; i >>= 1)
+            queue[i] = queue[i >> 1];
+
+        queue[i] = qe;
+    }
+
+    void pop()
+    {
+        QueueEntry qe = queue[queue_size];
+
+        int i = 1;
+        queue_size--;
+
+        while((i << 1) < (queue_size + 1))
+        {
+            int child = (i << 1);
+
+            if(child + 1 < queue_size + 1 && queue[child + 1].time < queue[child].time)
+                child++;
+
+            if(qe.time <= queue[child].time)
+                break;
+
+            queue[i] = queue[child];
+            i = child;
+        }
+
+        queue[i] = qe;
+    }
+
+    // Save or restore with a nall::serializer, chip(s, Chip*&) handles the chip pointers.
+    // The heap array is kept as is, so equal times pop in the same order.
+    template <class S, class F> void serialize(S& s, F chip)
+    {
+        s.integer(queue_size);
+
+        for(int i = 1; i <= queue_size; i++)
+        {
+            s.integer(queue[i].time);
+            chip(s, queue[i].chip);
+        }
+    }
+
+    // Point a copied queue at another circuit's chips, chip(Chip*) gives the new pointer
+    template <class F> void remap(F chip)
+    {
+        for(int i = 1; i <= queue_size; i++)
+            queue[i].chip = chip(queue[i].chip);
+    }
+};
+
+// Calendar queue (single level timing wheel). Events are hashed into
+// buckets of 2^BUCKET_SHIFT ps, each bucket is a short time-sorted list.
+// A bitmap of non-empty buckets finds the next event without scanning
+// empty buckets. Events further away than the wheel horizon (555 timers,
+// audio sample clock, etc.) go to an overflow heap. The wheel's node pool
+// grows when it runs out: an event at the current time must not go to the
+// overflow heap, top() would change while it is being processed.
+//
+// Events due at the same time leave a bucket in the order they were pushed.
+// HeapQueue's order for them depends on the heap's layout, so the two queues
+// run such events in a different order. Most games don't depend on it, but
+// Shark JAWS and Stunt Cycle draw different frames. This can't be matched without
+// replaying the heap's sift order.
+class CalendarQueue
+{
+public:
+    static const int BUCKET_SHIFT = 16; // 65.5 ns per bucket
+    static const int NUM_BUCKETS = 4096; // ~268 us horizon
+    static const int BUCKET_MASK = NUM_BUCKETS - 1;
+
+    CalendarQueue() : now(0), node(MAX_QUEUE_SIZE), next(MAX_QUEUE_SIZE)
+    {
+        clear_wheel();
+    }
+
+    bool empty() const { return count == 0 && overflow.empty(); }
+    int size() const { return count + overflow.size(); }
+
+    // Only valid when !empty(). Ties go to the overflow heap, pop() makes the same choice.
+    const QueueEntry& top() const
+    {
+        if(count == 0 || (!overflow.empty() && overflow.top().time <= node[bucket[first & BUCKET_MASK]].time))
+            return overflow.top();
+
+        return node[bucket[first & BUCKET_MASK]];
+    }
+
+    // time must not be earlier than the last popped event
+    void push(uint64_t time, Chip* chip)
+    {
+        uint64_t abs_bucket = time >> BUCKET_SHIFT;
+
+        if(abs_bucket - (now >> BUCKET_SHIFT) >= NUM_BUCKETS)
+        {
+            overflow.push(time, chip);
+            return;
+        }
+
+        if(free_list == NIL) grow();
+
+        int n = free_list;
+        free_list = next[n];
+        node[n] = QueueEntry(time, chip);
+
+        // Keep bucket sorted, equal times stay in FIFO order
+        int b = abs_bucket & BUCKET_MASK;
+        int* link = &bucket[b];
+        while(*link != NIL && node[*link].time <= time)
+            link = &next[*link];
+
+        next[n] = *link;
+        *link = n;
+
+        bitmap[b >> 6] |= uint64_t(1) << (b & 63);
+
+        if(count == 0 || abs_bucket < first) first = abs_bucket;
+        count++;
+    }
+
+    void pop()
+    {
+        int b = first & BUCKET_MASK;
+
+        if(count == 0 || (!overflow.empty() && overflow.top().time <= node[bucket[b]].time))
+        {
+            now = overflow.top().time;
+            overflow.pop();
+            return;
+        }
+
+        int n = bucket[b];
+        now = node[n].time;
+
+        bucket[b] = next[n];
+        next[n] = free_list;
+        free_list = n;
+        count--;
+
+        if(bucket[b] == NIL)
+        {
+            bitmap[b >> 6] &= ~(uint64_t(1) << (b & 63));
+            if(count) first += find_next(b);
+        }
+    }
+
+    // Save or restore with a nall::serializer, see HeapQueue::serialize().
+    // Wheel events are saved bucket by bucket in list order; pushing them
+    // back in that order rebuilds lists that pop in the same order.
+    template <class S, class F> void serialize(S& s, F chip)
+    {
+        overflow.serialize(s, chip);
+        s.integer(now);
+
+        int n = count;
+        s.integer(n);
+
+        if(s.mode() == S::Load)
+        {
+            clear_wheel();
+            for(int i = 0; i < n; i++)
+            {
+                QueueEntry e;
+                s.integer(e.time);
+                chip(s, e.chip);
+                push(e.time, e.chip);
+            }
+        }
+        else for(int b = 0; b < NUM_BUCKETS; b++)
+            for(int i = bucket[b]; i != NIL; i = next[i])
+            {
+                s.integer(node[i].time);
+                chip(s, node[i].chip);
+            }
+    }
+
+    // See HeapQueue::remap()
+    template <class F> void remap(F chip)
+    {
+        overflow.remap(chip);
+
+        for(int b = 0; b < NUM_BUCKETS; b++)
+            for(int i = bucket[b]; i != NIL; i = next[i])
+                node[i].chip = chip(node[i].chip);
+    }
+
+private:
+    static const int NIL = -1;
+
+    uint64_t now;   // Time of last popped event, all queued events are at or after it
+    uint64_t first; // Absolute bucket number of the earliest non-empty bucket
+    int count;      // Number of events in the wheel
+
+    int bucket[NUM_BUCKETS];
+    uint64_t bitmap[NUM_BUCKETS / 64];
+
+    std::vector<QueueEntry> node; // Wheel events, linked by next
+    std::vector<int> next;
+    int free_list;
+
+    HeapQueue overflow;
+
+    void clear_wheel()
+    {
+        first = 0;
+        count = 0;
+        for(int i = 0; i < NUM_BUCKETS; i++) bucket[i] = NIL;
+        for(int i = 0; i < NUM_BUCKETS / 64; i++) bitmap[i] = 0;
+        link_free(0);
+    }
+
+    // Doubles the node pool, lists hold indices so they stay valid
+    void grow()
+    {
+        int size = node.size();
+        node.resize(size * 2);
+        next.resize(size * 2);
+        link_free(size);
+    }
+
+    // Nodes from first on make up the free list
+    void link_free(int first)
+    {
+        int size = next.size();
+        for(int i = first; i < size; i++) next[i] = i + 1;
+        next[size - 1] = NIL;
+        free_list = first;
+    }
+
+    // Distance from bucket b to the next non-empty bucket, wrapping around.
+    // Requires count > 0.
+    int find_next(int b) const
+    {
+        int w = b >> 6;
+        uint64_t bits = bitmap[w] & (~uint64_t(0) << (b & 63));
+
+        while(bits == 0)
+        {
+            w = (w + 1) & (NUM_BUCKETS / 64 - 1);
+            bits = bitmap[w];
+        }
+
+        int found = (w << 6) + __builtin_ctzll(bits);
+        return (found - b) & BUCKET_MASK;
+    }
+};
+
+#endif
@@ -0,0 +1,238 @@
+/*--------------------------------------------------------------------
+    DICE 0.9a  –  forkserver.cpp
+    Builds a game once and serves each client from a fork()ed worker
+    process, see forkserver.h for the protocol
+--------------------------------------------------------------------*/
+
+#include <phoenix.hpp>
+#include <nall/platform.hpp>
+
+using namespace nall;
+using namespace phoenix;
+
+#include "circuit.h"
+#include "circuit_desc.h"
+#include "game_list.h"
+#include "environment.h"
+#include "forkserver.h"
+
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*====================================================================
+    Global helpers (referenced by chips/rom.cpp)
+====================================================================*/
+static nall::string app_path;
+
+const nall::string& application_path()  { return app_path; }
+Window&             application_window(){ return Window::none(); }
+
+static void usage()
+{
+    printf("usage: dice_forkserver <game> [-socket path] [-warm seconds] [-video luma|rgb] [-size WxH]\n");
+    printf("games:");
+    for(const GameDesc& g : game_list) printf(" %s", g.command_line);
+    printf("\n");
+}
+
+static bool read_all(int fd, void* data, size_t size)
+{
+    uint8_t* p = (uint8_t*)data;
+    while(size)
+    {
+        ssize_t n = read(fd, p, size);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool write_all(int fd, const void* data, size_t size)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    while(size)
+    {
+        ssize_t n = write(fd, p, size);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+/*====================================================================
+    Worker: serves one connection until the client closes it
+====================================================================*/
+static bool send_reply(int fd, Environment& env, const Environment::Observation& obs, uint32_t status)
+{
+    const VideoFramebuffer& fb = env.video();
+
+    ForkServer::Reply reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.status      = status;
+    reply.frame_count = obs.frame_count;
+    reply.time        = obs.time;
+    reply.timed_out   = obs.timed_out;
+    reply.frame_size  = fb.frameSize();
+    reply.width       = fb.frameWidth();
+    reply.height      = fb.frameHeight();
+    reply.format      = fb.frameFormat();
+
+    return write_all(fd, &reply, sizeof(reply)) && write_all(fd, obs.frame, reply.frame_size);
+}
+
+static int serve(int fd, Environment& env, const Environment::Observation& initial)
+{
+    if(!send_reply(fd, env, initial, 0)) return 1;
+
+    Environment::Observation obs = initial;
+    ForkServer::Request request;
+    while(read_all(fd, &request, sizeof(request)))
+    {
+        uint32_t status = 0;
+
+        if(request.op == ForkServer::STEP && request.frames > 0)
+        {
+            Environment::Action action;
+            for(unsigned p = 0; p < InputInjected::MAX_PADDLES; p++)
+                action.paddle[p] = request.paddle[p];
+            action.buttons = request.buttons;
+
+            obs = env.step(action, request.frames);
+        }
+        else if(request.op == ForkServer::RESET)
+            obs = env.reset();
+        else
+            status = 1; // Nothing run, same observation
+
+        if(!send_reply(fd, env, obs, status)) return 1;
+    }
+
+    return 0;
+}
+
+/*====================================================================
+    main()
+====================================================================*/
+int main(int argc, char** argv)
+{
+    app_path = dir(realpath(argv[0]));
+
+    if(argc < 2)
+    {
+        usage();
+        return 1;
+    }
+
+    std::string socket_path;
+    double      warm       = 0.0;
+    std::string video_mode = "luma";
+    unsigned    fb_width   = 320;
+    unsigned    fb_height  = 240;
+
+    /* ---------- parse CLI flags ---------- */
+    for(int i = 2; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "-socket") == 0 && i+1 < argc)
+            socket_path = argv[++i];
+        else if(strcmp(argv[i], "-warm") == 0 && i+1 < argc)
+            warm = atof(argv[++i]);
+        else if(strcmp(argv[i], "-video") == 0 && i+1 < argc)
+            video_mode = argv[++i];
+        else if(strcmp(argv[i], "-size") == 0 && i+1 < argc)
+            sscanf(argv[++i], "%ux%u", &fb_width, &fb_height);
+    }
+
+    const GameDesc* game = nullptr;
+    for(const GameDesc& g : game_list)
+        if(strcmp(argv[1], g.command_line) == 0)
+            game = &g;
+
+    if(game == nullptr)
+    {
+        usage();
+        return 1;
+    }
+
+    if(socket_path.empty())
+        socket_path = std::string("dice_") + game->command_line + ".sock";
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(socket_path.size() >= sizeof(addr.sun_path))
+    {
+        printf("Socket path too long: %s\n", socket_path.c_str());
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path.c_str());
+
+    // Built and warmed up once, every worker starts from here
+    srand(0);
+    VideoFramebuffer::Format format = video_mode == "rgb" ? VideoFramebuffer::RGB24 : VideoFramebuffer::LUMA8;
+    Environment env(game->desc, game->command_line, fb_width, fb_height, format);
+
+    Environment::Observation initial = env.reset();
+    if(warm > 0.0)
+    {
+        uint64_t end_time = uint64_t(warm / Circuit::timescale);
+        while(initial.time < end_time && !initial.timed_out)
+            initial = env.step(Environment::Action());
+
+        printf("%s: warmed up for %u frames, %.3f s\n", game->name, initial.frame_count, initial.time * Circuit::timescale);
+
+        // Workers count from the checkpoint, like after a RESET
+        env.checkpoint();
+        initial = env.reset();
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path.c_str());
+    if(listener < 0 || bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 64) != 0)
+    {
+        printf("Unable to listen on %s: %s\n", socket_path.c_str(), strerror(errno));
+        return 1;
+    }
+
+    // Workers are reaped automatically, a crashing one only drops its client
+    signal(SIGCHLD, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("%s: %u chips, listening on %s\n", game->name, unsigned(env.circuit().chips.size()), socket_path.c_str());
+    fflush(stdout);
+
+    while(true)
+    {
+        int fd = accept(listener, nullptr, nullptr);
+        if(fd < 0)
+        {
+            if(errno == EINTR) continue;
+            printf("accept: %s\n", strerror(errno));
+            break;
+        }
+
+        pid_t pid = fork();
+        if(pid == 0)
+        {
+            close(listener);
+            _exit(serve(fd, env, initial));
+        }
+
+        if(pid < 0) printf("fork: %s\n", strerror(errno));
+        close(fd);
+    }
+
+    close(listener);
+    unlink(socket_path.c_str());
+    return 1;
+}
@@ -0,0 +1,47 @@
+#ifndef FORKSERVER_H
+#define FORKSERVER_H
+
+#include <stdint.h>
+
+// Protocol of dice_forkserver. The server builds one game, optionally runs it
+// to a warm state, then listens on a UNIX stream socket. Each connection is
+// served by a worker process fork()ed from the server: it starts from the
+// server's state and owns an independent copy of the game (an Environment).
+// LUTs, fan-out and ROM data are never written after the build and stay
+// shared with the server through copy-on-write pages, a worker only gets
+// private copies of the chip state it runs.
+//
+// On connect the worker sends a Reply for the initial state, then answers each
+// Request with a Reply. Every Reply is followed by frame_size bytes of frame
+// (VideoFramebuffer layout). Closing the connection ends the worker. Structs
+// are sent as they are, little endian.
+namespace ForkServer
+{
+    enum Op
+    {
+        STEP = 0,   // Apply paddle and buttons, run frames frames
+        RESET = 1   // Back to the server's state, paddle and buttons ignored
+    };
+
+    struct Request
+    {
+        uint32_t op;
+        uint32_t frames;     // STEP: at least 1
+        double   paddle[4];  // Environment::Action::paddle, NaN leaves a paddle where it is
+        uint32_t buttons;    // Environment::Action::Button bits
+        uint32_t reserved;
+    };
+
+    struct Reply
+    {
+        uint32_t status;      // 0, or 1 for an invalid request
+        uint32_t frame_count; // Environment::Observation
+        uint64_t time;
+        uint32_t timed_out;
+        uint32_t frame_size;
+        uint16_t width, height;
+        uint32_t format;      // VideoFramebuffer::Format
+    };
+}
+
+#endif
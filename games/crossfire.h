@@ -201,6 +201,9 @@ struct FireSoundDesc
 
 public:
     FireSoundDesc(Astable555Desc* d) : desc(d) { }
+
+    void serialize(nall::serializer& s) { s(cap_v); }
+    void relink(const CustomDataLinks& links) { links(desc); }
 };
 
 static CUSTOM_LOGIC( fire_cv )
@@ -42,14 +42,29 @@ static VcdLogDesc vcd_log_desc
 MixerDesc mixer1_desc({K_OHM(1.0)}, K_OHM(1.0));
 MixerDesc mixer2_desc({K_OHM(1.0), K_OHM(1.5) /*Thevenin resistance*/});
 
+// Capacitor charged by the proximity detector, its voltage is the control voltage of timer (E8)
+struct ProximityDesc
+{
+    double v_cap;
+    Astable555Desc* timer;
+
+    ProximityDesc(Astable555Desc* t) : v_cap(0.0), timer(t) { }
+
+    void serialize(nall::serializer& s) { s(v_cap); }
+    void relink(const CustomDataLinks& links) { links(timer); }
+};
+
+static ProximityDesc proximity_desc(&e8_555_desc);
+
 static CUSTOM_LOGIC( proximity )
 {
+    ProximityDesc* desc = (ProximityDesc*)chip->custom_data;
+
     // Thevenin voltage + resistance
     static const double v_th[4] = { 1.337, 1.521, 2.737, 3.815 };
     static const double r_th = K_OHM(1.5); // TODO: Figure this out more accurately?
     static const double rc = r_th*U_FARAD(0.1);
 
-    static double v_cap = 0.0;
     static const double v_base = 2.0; // TODO: Make adjustable?
 
     double v = v_th[chip->inputs & 3]; 
@@ -59,11 +74,11 @@ static CUSTOM_LOGIC( proximity )
     double dt = double(chip->circuit->global_time - chip->last_output_event) * Circuit::timescale;
     double rc_exp = 1.0 - exp(-dt / rc);
     
-    v_cap += (v - v_cap) * rc_exp;
+    desc->v_cap += (v - desc->v_cap) * rc_exp;
 
     if(mask == 4)
     {
-        e8_555_desc.ctrl = v_cap;
+        desc->timer->ctrl = desc->v_cap;
         chip->pending_event = chip->circuit->queue_push(chip, 1);
     }
 
@@ -218,7 +233,7 @@ CIRCUIT_LAYOUT( gotcha )
     CHIP("POT1", POT_555_ASTABLE, &pot1_desc)
     POTENTIOMETER_CONNECTION("POT1", "D8") 
 
-    CHIP("PROXIMITY", PROXIMITY)
+    CHIP("PROXIMITY", PROXIMITY, &proximity_desc)
     POTENTIOMETER_CONNECTION("PROXIMITY", "E8") 
 
     CHIP("MIXER1", MIXER, &mixer1_desc)
@@ -30,7 +30,7 @@ static VcdLogDesc vcd_log_desc
 // ~16 ms period with 75% duty cycle, +/- 0.2 ms
 static CUSTOM_LOGIC( RANDOM_CLOCK_GEN )
 {
-    Chip* output_chip = chip->output_links.front().chip;
+    Chip* output_chip = chip->output_chip(0);
     
     double r = 2.0E-4 * (double(rand()) / RAND_MAX - 0.5);
     double hi_time = (1.0 / 60.0) * 0.75 + r;
@@ -1581,7 +1581,7 @@ CUSTOM_LOGIC( StuntCycleThrottleDesc::stuntcycle_throttle )
     {
         desc->cap_voltage = 5.0; // Assume this happens instantly
         pos = 5.0;
-        chip->output_links[0].chip->pending_event = 0; // Disable speed pulses
+        chip->output_chip(0)->pending_event = 0; // Disable speed pulses
     }
     else 
     {
@@ -1617,7 +1617,7 @@ CUSTOM_LOGIC( StuntCycleThrottleDesc::stuntcycle_throttle )
         //         chip->circuit->global_time, t, tc, exp(-t/tc), pos, desc->cap_voltage, R, period);
 
         // Update speed pulse period
-        Chip* c = chip->output_links[0].chip;
+        Chip* c = chip->output_chip(0);
         uint64_t pend = c->pending_event;
         c->deactivate_outputs();
         c->pending_event = pend;
@@ -1638,7 +1638,7 @@ CUSTOM_LOGIC( StuntCycleThrottleDesc::stuntcycle_throttle )
 
     // Calculate op-amp outputs. TODO: Determine correct behavior?
     int new_out = 0;
-    Chip* c = chip->output_links[1].chip;
+    Chip* c = chip->output_chip(1);
 
     if(desc->cap_voltage > pos + 1.5) 
         new_out = 1;
@@ -1647,7 +1647,7 @@ CUSTOM_LOGIC( StuntCycleThrottleDesc::stuntcycle_throttle )
         c->pending_event = c->circuit->queue_push(c, c->delay[c->output]);
 
     new_out = 0;
-    c = chip->output_links[2].chip;
+    c = chip->output_chip(2);
 
     if(desc->cap_voltage > pos + 0.75)
         new_out = 1;
@@ -20,7 +20,7 @@ static CUSTOM_LOGIC( paddle_control )
     WipeoutPaddleDesc* desc = (WipeoutPaddleDesc*)chip->custom_data;
 
     // Update tp_hl in standard portion based on rc value
-    if(chip->output_links.size())
+    if(chip->output_count)
     {
         // Current through 270 ohm resistor (Approximate)
         double i = 5.0 / desc->r;
@@ -28,7 +28,7 @@ static CUSTOM_LOGIC( paddle_control )
         // Time to charge capacitor to 2V. dt = C * 2 / i
         double dt = desc->c * 2.0 / i;
         
-        chip->output_links[0].chip->delay[0] = uint64_t(dt / Circuit::timescale);
+        chip->output_chip(0)->delay[0] = uint64_t(dt / Circuit::timescale);
 
         // Generate event to standard portion of chip
         chip->pending_event = chip->circuit->queue_push(chip, 0);
@@ -0,0 +1,646 @@
+/*--------------------------------------------------------------------
+    DICE 0.9a  –  headless.cpp
+    Runs a game with no window, audio device or input devices
+--------------------------------------------------------------------*/
+
+#include <phoenix.hpp>
+#include <nall/platform.hpp>
+
+using namespace nall;
+using namespace phoenix;
+
+#include "circuit.h"
+#include "circuit_desc.h"
+#include "game_list.h"
+
+#include "chips/video_null.h"
+#include "chips/video_framebuffer.h"
+#include "chips/audio_null.h"
+#include "chips/input_null.h"
+#include "circuit_batch.h"
+#include "environment.h"
+#include "run_ahead.h"
+#include "optimizer_verifier.h"
+#include "netlist_image.h"
+#include "hint_table.h"
+
+#include <string>
+#include <cstdlib>
+#include <ctime>
+#include <cmath>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+/*====================================================================
+    Global helpers (referenced by chips/rom.cpp)
+====================================================================*/
+static nall::string app_path;
+
+const nall::string& application_path()  { return app_path; }
+Window&             application_window(){ return Window::none(); }
+
+static void usage()
+{
+    printf("usage: dice_headless <game> [-seconds N] [--dump-state file] [--dump-state-frame file]\n");
+    printf("                     [--dump-format raw|delta]\n");
+    printf("                     [-video null|luma|rgb] [-size WxH] [--dump-frame file]\n");
+    printf("                     [-queue heap|calendar] [-instances N [-threads T]] [-env [-warm frames]] [-runahead N]\n");
+    printf("                     [-record journal | -replay journal] [-noimage] [-profile chips]\n");
+    printf("                     [-noadaptive | -adaptive-log]\n");
+    printf("       dice_headless --bench-queues [-seconds N]\n");
+    printf("       dice_headless --bench-build\n");
+    printf("       dice_headless --build-images\n");
+    printf("       dice_headless <game> --tune-hints [-seconds N]\n");
+    printf("       dice_headless <game> --verify-optimizer [-seconds N] [-noadaptive]\n");
+    printf("games:");
+    for(const GameDesc& g : game_list) printf(" %s", g.command_line);
+    printf("\n");
+}
+
+/*====================================================================
+    Event queue benchmark: every game on each queue implementation.
+    Each run is forked so games start from pristine static chip
+    descriptors and don't affect each other's timing.
+====================================================================*/
+static double bench_run(const GameDesc& g, unsigned queue, double seconds)
+{
+    int fd[2];
+    if(pipe(fd) != 0) return 0.0;
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        close(fd[0]);
+        if(!freopen("/dev/null", "w", stdout)) _exit(1); // Hide netlist warnings
+
+        Settings settings;
+        settings.throttle = false;
+        settings.event_queue = queue;
+
+        InputNull input;
+        VideoNull video;
+        AudioNull audio;
+
+        srand(0);
+        Circuit* circuit = new Circuit(settings, input, video, audio, g.desc, g.command_line);
+
+        RealTimeClock real_time;
+        circuit->run(seconds / Circuit::timescale);
+        double elapsed = real_time.get_usecs() * 1.0e-6;
+
+        double events_per_sec = circuit->event_count / elapsed;
+        if(write(fd[1], &events_per_sec, sizeof(events_per_sec)) != sizeof(events_per_sec)) _exit(1);
+        _exit(0);
+    }
+
+    close(fd[1]);
+    double events_per_sec = 0.0;
+    if(pid < 0 || read(fd[0], &events_per_sec, sizeof(events_per_sec)) != sizeof(events_per_sec))
+        events_per_sec = 0.0;
+    close(fd[0]);
+    if(pid > 0) waitpid(pid, nullptr, 0);
+
+    return events_per_sec;
+}
+
+static int bench_queues(double seconds)
+{
+    printf("%-16s %14s %14s %8s\n", "game", "heap ev/s", "calendar ev/s", "speedup");
+
+    double total[2] = { 0.0, 0.0 };
+    for(const GameDesc& g : game_list)
+    {
+        double heap = bench_run(g, Settings::HEAP_QUEUE, seconds);
+        double calendar = bench_run(g, Settings::CALENDAR_QUEUE, seconds);
+
+        printf("%-16s %14.0f %14.0f %7.2fx\n", g.name, heap, calendar, calendar / heap);
+        fflush(stdout);
+
+        total[0] += heap;
+        total[1] += calendar;
+    }
+
+    printf("%-16s %14.0f %14.0f %7.2fx\n", "(sum)", total[0], total[1], total[1] / total[0]);
+    return 0;
+}
+
+/*====================================================================
+    Construction benchmark: time spent building each game, by step,
+    then the total when built from its netlist image. Forked like
+    bench_run, a game built before would find its chip descriptors
+    already used, and its LUTs in the pool.
+====================================================================*/
+struct BuildResult
+{
+    Circuit::BuildTimes times;
+    unsigned chips;
+};
+
+static bool build_run(const GameDesc& g, bool images, BuildResult& result)
+{
+    int fd[2];
+    if(pipe(fd) != 0) return false;
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        close(fd[0]);
+        if(!freopen("/dev/null", "w", stdout)) _exit(1); // Hide netlist warnings
+
+        Settings settings;
+        settings.netlist_images = images;
+
+        InputNull input;
+        VideoNull video;
+        AudioNull audio;
+
+        Circuit* circuit = new Circuit(settings, input, video, audio, g.desc, g.command_line);
+
+        BuildResult r = { circuit->build_times, unsigned(circuit->chips.size()) };
+        if(write(fd[1], &r, sizeof(r)) != sizeof(r)) _exit(1);
+        _exit(0);
+    }
+
+    close(fd[1]);
+    bool ok = pid > 0 && read(fd[0], &result, sizeof(result)) == sizeof(result);
+    close(fd[0]);
+    if(pid > 0) waitpid(pid, nullptr, 0);
+
+    return ok;
+}
+
+static int bench_build()
+{
+    printf("%-16s %6s %7s %8s %8s %8s %8s %8s %8s %8s %7s\n", "game", "chips", "removed",
+           "chips ms", "conn ms", "prune ms", "link ms", "init ms", "total ms", "image ms", "evals");
+
+    double total = 0.0, image_total = 0.0;
+    for(const GameDesc& g : game_list)
+    {
+        // The second build with images on writes the image if needed, the third loads it
+        BuildResult r, image;
+        if(!build_run(g, false, r) || !build_run(g, true, image) || !build_run(g, true, image))
+        {
+            printf("%-16s failed\n", g.name);
+            continue;
+        }
+
+        const Circuit::BuildTimes& t = r.times;
+        printf("%-16s %6u %7u %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f", g.name, r.chips, t.removed,
+               t.chips * 1.0e3, t.connections * 1.0e3, t.pruning * 1.0e3, t.linking * 1.0e3, t.init * 1.0e3, t.total * 1.0e3);
+
+        if(image.times.from_image)
+            printf(" %8.2f", image.times.total * 1.0e3);
+        else
+            printf(" %8s", "-");
+
+        printf(" %7u%s\n", t.settle_evaluations, t.unsettled ? " (not settled)" : "");
+        fflush(stdout);
+
+        total += t.total;
+        image_total += image.times.total;
+    }
+
+    printf("%-16s %62.2f %8.2f\n", "(sum)", total * 1.0e3, image_total * 1.0e3);
+    return 0;
+}
+
+/*====================================================================
+    Writes the netlist image of every game that doesn't have an
+    up to date one, e.g. as a build step before starting workers
+====================================================================*/
+static int build_images()
+{
+    int failed = 0;
+    for(const GameDesc& g : game_list)
+    {
+        BuildResult r;
+        bool ok = build_run(g, true, r);
+        if(ok && !r.times.from_image) ok = build_run(g, true, r) && r.times.from_image;
+
+        if(ok) printf("%-16s %6u chips  %s\n", g.name, r.chips, NetlistImage::defaultPath(g.command_line).c_str());
+        else   printf("%-16s failed\n", g.name);
+        fflush(stdout);
+
+        if(!ok) failed++;
+    }
+
+    return failed ? 1 : 0;
+}
+
+/*====================================================================
+    Measures event queue and sub-cycle needs of a game's chips and
+    writes its HintTable, used by the next builds: a run with the
+    current sizes, one with the sizes to try, and one with the sizes
+    that paid off. Runs are played (InputInjected::play()): queues
+    sized from attract mode alone overflow once someone plays.
+====================================================================*/
+static ChipProfiler::InstanceMap tune_run(const GameDesc& g, double seconds, const char* sizes)
+{
+    Settings settings;
+    settings.throttle = false;
+    settings.copy_custom_data = true; // Every run starts from the netlist's custom_data
+
+    InputInjected input;
+    VideoNull video;
+    AudioNull audio;
+
+    srand(0);
+    Circuit* circuit = new Circuit(settings, input, video, audio, g.desc, g.command_line);
+    circuit->setProfiling(true);
+
+    unsigned steps = unsigned(ceil(seconds / InputInjected::PLAY_STEP));
+    for(unsigned i = 0; i < steps; i++)
+    {
+        input.play(settings, i * InputInjected::PLAY_STEP);
+        circuit->run(InputInjected::PLAY_STEP / Circuit::timescale);
+    }
+
+    unsigned long long activations = 0, overflows = 0, subcycle_full = 0, queue_slots = 0;
+    for(size_t i = 0; i < circuit->chips.size(); i++)
+    {
+        const ChipProfiler::Counters& c = circuit->profiler->data()[i];
+        activations += c.activations;
+        overflows += c.queue_overflows;
+        subcycle_full += c.subcycle_full;
+        if(circuit->tables->chip_hinted[i]) queue_slots += circuit->chips[i]->first_output_event.getQueueSize();
+    }
+
+    printf("%-16s %-8s %12llu %12llu %12llu %12llu\n", g.name, sizes, activations, overflows, subcycle_full, queue_slots);
+    fflush(stdout);
+
+    ChipProfiler::InstanceMap instances = circuit->profiler->instances(*circuit);
+    delete circuit;
+    return instances;
+}
+
+static int tune_hints(const GameDesc& g, double seconds)
+{
+    std::string path = HintTable::defaultPath(g.command_line);
+    HintTable hints;
+    hints.load(path);
+
+    printf("%-16s %-8s %12s %12s %12s %12s\n", "game", "sizes", "cycles found", "overflows", "sub-cycles", "queue slots");
+    fflush(stdout);
+
+    ChipProfiler::InstanceMap measured = tune_run(g, seconds, "current");
+    if(ChipProfiler::tuneHints(measured, nullptr, hints))
+    {
+        if(!hints.save(path, g.command_line))
+        {
+            printf("Unable to write %s\n", path.c_str());
+            return 1;
+        }
+
+        ChipProfiler::InstanceMap trial = tune_run(g, seconds, "trial");
+        ChipProfiler::tuneHints(measured, &trial, hints);
+        if(!hints.save(path, g.command_line))
+        {
+            printf("Unable to write %s\n", path.c_str());
+            return 1;
+        }
+
+        tune_run(g, seconds, "tuned");
+    }
+
+    printf("%s: %u instances in %s\n", g.name, unsigned(hints.hints.size()), path.c_str());
+    return 0;
+}
+
+/*====================================================================
+    Frame as binary PGM (LUMA8) or PPM (RGB24)
+====================================================================*/
+static void write_frame(const VideoFramebuffer& fb, const std::string& path)
+{
+    FILE* f = fopen(path.c_str(), "wb");
+    if(f)
+    {
+        bool rgb = fb.frameFormat() == VideoFramebuffer::RGB24;
+        fprintf(f, "P%c\n%u %u\n255\n", rgb ? '6' : '5', fb.frameWidth(), fb.frameHeight());
+        fwrite(fb.frame(), 1, fb.frameSize(), f);
+        fclose(f);
+    }
+    else
+        printf("Unable to open %s\n", path.c_str());
+}
+
+/*====================================================================
+    Environment mode: step() one frame at a time, sweeping the
+    paddles back and forth and pressing coin/start at the beginning
+====================================================================*/
+static int run_env(const GameDesc& g, double seconds, unsigned warm_frames, const std::string& frame_path)
+{
+    RealTimeClock real_time;
+    Environment env(g.desc, g.command_line, 320, 240, VideoFramebuffer::LUMA8, warm_frames);
+    double start_time = real_time.get_usecs() * 1.0e-6;
+    if(warm_frames)
+        printf("%s: started %u frames after power-on in %.1f ms\n", g.name, warm_frames, start_time * 1.0e3);
+
+    real_time = RealTimeClock();
+    uint64_t end_time = env.circuit().global_time + uint64_t(seconds / Circuit::timescale);
+    Environment::Observation obs = env.reset();
+
+    while(obs.time < end_time && !obs.timed_out)
+    {
+        Environment::Action action;
+        for(unsigned p = 0; p < InputInjected::MAX_PADDLES; p++)
+            action.paddle[p] = 0.5 + 0.5 * sin(obs.frame_count * 0.05 + p);
+
+        if(obs.frame_count >= 30 && obs.frame_count < 40)      action.press(Environment::Action::COIN1);
+        else if(obs.frame_count >= 60 && obs.frame_count < 70) action.press(Environment::Action::START1);
+
+        obs = env.step(action);
+    }
+    double elapsed = real_time.get_usecs() * 1.0e-6;
+
+    printf("%s: %u frames through step() in %.3f s (%.0f frames/s)%s\n", g.name, obs.frame_count, elapsed,
+           obs.frame_count / elapsed, obs.timed_out ? ", stopped producing frames" : "");
+
+    if(!frame_path.empty())
+        write_frame(env.video(), frame_path);
+
+    return 0;
+}
+
+/*====================================================================
+    Batch mode: N isolated instances stepped a frame at a time
+====================================================================*/
+static int run_batch(const GameDesc& g, unsigned instances, unsigned threads, double seconds)
+{
+    CircuitBatch batch(g.desc, g.command_line, instances, threads);
+
+    RealTimeClock real_time;
+    uint64_t end_time = uint64_t(seconds / Circuit::timescale);
+    unsigned frames = 0;
+
+    while(batch[0].circuit->global_time < end_time)
+    {
+        batch.step();
+        frames++;
+    }
+    double elapsed = real_time.get_usecs() * 1.0e-6;
+
+    printf("%s: %u instances on %u threads, %u frames each in %.3f s (%.0f frames/s total)\n",
+           g.name, instances, batch.threadCount(), frames, elapsed, frames * instances / elapsed);
+    return 0;
+}
+
+/*====================================================================
+    Run-ahead mode: the interactive frame loop, unthrottled, with the
+    latency readout. Latency includes the unthrottled emulation time.
+====================================================================*/
+static int run_ahead(const GameDesc& g, unsigned frames, double seconds)
+{
+    Settings settings;
+    settings.throttle = false;
+
+    InputNull input;
+    VideoNull video;
+    AudioNull audio;
+
+    Circuit* circuit = new Circuit(settings, input, video, audio, g.desc, g.command_line);
+    RunAhead run_ahead(*circuit, frames);
+
+    RealTimeClock real_time;
+    uint64_t end_time = uint64_t(seconds / Circuit::timescale);
+    while(circuit->global_time < end_time && run_ahead.run_frame(Environment::MAX_FRAME_TIME / Circuit::timescale));
+    double elapsed = real_time.get_usecs() * 1.0e-6;
+
+    printf("%s: %u frames in %.3f s, run-ahead %u: %.1f ms ahead, %.2f ms lookahead per frame, latency %.2f ms\n",
+           g.name, run_ahead.sampleCount(), elapsed, frames, run_ahead.ahead() * 1.0e3,
+           run_ahead.overhead() * 1.0e3, run_ahead.latency() * 1.0e3);
+
+    delete circuit;
+    return 0;
+}
+
+/*====================================================================
+    Cycle optimizer check: the game with and without it in lockstep,
+    compared every frame. Exits with 1 when they diverge.
+====================================================================*/
+static int verify_optimizer(const GameDesc& g, double seconds, bool adaptive)
+{
+    Settings settings;
+    settings.throttle = false;
+    settings.copy_custom_data = true;
+    settings.adaptive_optimization = adaptive;
+
+    InputNull input;
+    OptimizerVerifier verifier(settings, input, g.desc, g.command_line);
+
+    RealTimeClock real_time;
+    uint64_t end_time = uint64_t(seconds / Circuit::timescale);
+    while(verifier.circuit().global_time < end_time && verifier.step(Environment::MAX_FRAME_TIME / Circuit::timescale));
+    double elapsed = real_time.get_usecs() * 1.0e-6;
+
+    verifier.report(stdout, g.name);
+    printf("%.3f s\n", elapsed);
+
+    return verifier.divergence().found ? 1 : 0;
+}
+
+/*====================================================================
+    main()
+====================================================================*/
+int main(int argc, char** argv)
+{
+    app_path = dir(realpath(argv[0]));
+    srand(time(nullptr));
+
+    if(argc < 2)
+    {
+        usage();
+        return 1;
+    }
+
+    double      seconds   = 10.0;
+    unsigned    queue     = Settings::HEAP_QUEUE;
+    unsigned    instances = 0;
+    unsigned    threads   = 0;
+    std::string dump_path;
+    SampleMode  smode     = SampleMode::Tick;
+    DumpFormat  dformat   = DumpFormat::Raw;
+    std::string video_mode = "null";
+    unsigned    fb_width  = 320;
+    unsigned    fb_height = 240;
+    std::string frame_path;
+    bool        env_mode  = false;
+    unsigned    warm_frames = 0;
+    int         ahead     = -1;
+    std::string record_path;
+    std::string replay_path;
+    bool        images    = true;
+    unsigned    profile   = 0;
+    bool        tune      = false;
+    bool        adaptive  = true;
+    bool        adaptive_log = false;
+    bool        verify    = false;
+
+    /* ---------- parse CLI flags ---------- */
+    for(int i = 2; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "-seconds") == 0 && i+1 < argc)
+            seconds = atof(argv[++i]);
+        else if(strcmp(argv[i], "--dump-state") == 0 && i+1 < argc)
+        {
+            dump_path = argv[++i];
+            smode     = SampleMode::Tick;
+        }
+        else if(strcmp(argv[i], "--dump-state-frame") == 0 && i+1 < argc)
+        {
+            dump_path = argv[++i];
+            smode     = SampleMode::FrameEdge;
+        }
+        else if(strcmp(argv[i], "--dump-format") == 0 && i+1 < argc)
+            dformat = strcmp(argv[++i], "delta") == 0 ? DumpFormat::Delta : DumpFormat::Raw;
+        else if(strcmp(argv[i], "-video") == 0 && i+1 < argc)
+            video_mode = argv[++i];
+        else if(strcmp(argv[i], "-size") == 0 && i+1 < argc)
+            sscanf(argv[++i], "%ux%u", &fb_width, &fb_height);
+        else if(strcmp(argv[i], "--dump-frame") == 0 && i+1 < argc)
+            frame_path = argv[++i];
+        else if(strcmp(argv[i], "-queue") == 0 && i+1 < argc)
+            queue = strcmp(argv[++i], "calendar") == 0 ? Settings::CALENDAR_QUEUE : Settings::HEAP_QUEUE;
+        else if(strcmp(argv[i], "-instances") == 0 && i+1 < argc)
+            instances = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-threads") == 0 && i+1 < argc)
+            threads = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-env") == 0)
+            env_mode = true;
+        else if(strcmp(argv[i], "-warm") == 0 && i+1 < argc)
+            warm_frames = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-runahead") == 0 && i+1 < argc)
+            ahead = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-record") == 0 && i+1 < argc)
+            record_path = argv[++i];
+        else if(strcmp(argv[i], "-replay") == 0 && i+1 < argc)
+            replay_path = argv[++i];
+        else if(strcmp(argv[i], "-noimage") == 0)
+            images = false;
+        else if(strcmp(argv[i], "-profile") == 0 && i+1 < argc)
+            profile = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--tune-hints") == 0)
+            tune = true;
+        else if(strcmp(argv[i], "-noadaptive") == 0)
+            adaptive = false;
+        else if(strcmp(argv[i], "-adaptive-log") == 0)
+            adaptive_log = true;
+        else if(strcmp(argv[i], "--verify-optimizer") == 0)
+            verify = true;
+    }
+
+    if(strcmp(argv[1], "--bench-queues") == 0)
+        return bench_queues(seconds);
+
+    if(strcmp(argv[1], "--bench-build") == 0)
+        return bench_build();
+
+    if(strcmp(argv[1], "--build-images") == 0)
+        return build_images();
+
+    const GameDesc* game = nullptr;
+    for(const GameDesc& g : game_list)
+        if(strcmp(argv[1], g.command_line) == 0)
+            game = &g;
+
+    if(game == nullptr)
+    {
+        usage();
+        return 1;
+    }
+
+    if(tune)
+        return tune_hints(*game, seconds);
+
+    if(verify)
+        return verify_optimizer(*game, seconds, adaptive);
+
+    if(instances)
+        return run_batch(*game, instances, threads, seconds);
+
+    if(env_mode)
+        return run_env(*game, seconds, warm_frames, frame_path);
+
+    if(ahead >= 0)
+        return run_ahead(*game, ahead, seconds);
+
+    Settings settings;
+    settings.throttle = false;
+    settings.event_queue = queue;
+    settings.netlist_images = images;
+    settings.adaptive_optimization = adaptive;
+
+    InputNull input;
+    AudioNull audio;
+
+    VideoFramebuffer* framebuffer = nullptr;
+    if(video_mode == "luma")
+        framebuffer = new VideoFramebuffer(fb_width, fb_height, VideoFramebuffer::LUMA8);
+    else if(video_mode == "rgb")
+        framebuffer = new VideoFramebuffer(fb_width, fb_height, VideoFramebuffer::RGB24);
+    else if(!frame_path.empty())
+        framebuffer = new VideoFramebuffer(fb_width, fb_height, VideoFramebuffer::RGB24);
+
+    Video* video = framebuffer ? (Video*)framebuffer : new VideoNull();
+
+    // A replay runs as long as the recording did, with its seed
+    InputJournal* journal = nullptr;
+    uint32_t seed = time(nullptr);
+    int64_t run_time = seconds / Circuit::timescale;
+    try
+    {
+        if(!replay_path.empty())
+        {
+            journal = new InputJournal(replay_path);
+            if(strcmp(journal->game(), game->command_line) != 0)
+            {
+                printf("%s was recorded from %s\n", replay_path.c_str(), journal->game());
+                delete journal;
+                return 1;
+            }
+            seed = journal->seed();
+            seconds = journal->endTime() * Circuit::timescale;
+            run_time = journal->endTime();
+        }
+        else if(!record_path.empty())
+            journal = new InputJournal(record_path, game->command_line, seed);
+    }
+    catch(const std::exception& e)
+    {
+        printf("%s\n", e.what());
+        return 1;
+    }
+    srand(seed);
+
+    Circuit* circuit = new Circuit(settings, input, *video, audio,
+                                   game->desc, game->command_line,
+                                   dump_path, smode, dformat);
+    circuit->journal.reset(journal);
+    if(profile) circuit->setProfiling(true);
+
+    RealTimeClock real_time;
+    circuit->run(run_time);
+    double elapsed = real_time.get_usecs() * 1.0e-6;
+
+    printf("%s: %g emulated seconds, %u frames in %.3f s (%.2fx real time)\n",
+           game->name, seconds, video->frame_count, elapsed, seconds / elapsed);
+    if(journal && journal->replaying())
+        printf("%s: %llu input polls replayed, %llu without a journaled value\n", replay_path.c_str(),
+               (unsigned long long)journal->pollCount(), (unsigned long long)journal->missCount());
+
+    if(profile)
+        circuit->profiler->report(stdout, *circuit, game->command_line, profile);
+
+    if(adaptive_log)
+        circuit->reportOptimizerDecisions(stdout, game->command_line);
+
+    if(framebuffer && !frame_path.empty())
+        write_frame(*framebuffer, frame_path);
+
+    delete circuit;
+    delete video;
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include <nall/platform.hpp>
+#include <nall/directory.hpp>
+
+#include "hint_table.h"
+
+#include <cstdio>
+
+using namespace nall;
+
+std::string HintTable::defaultPath(const char* game)
+{
+    string dir = {configpath(), "dice/hints/"};
+    directory::create(dir);
+
+    return std::string(dir.data()) + game + ".hints";
+}
+
+bool HintTable::load(const std::string& path)
+{
+    hints.clear();
+
+    FILE* f = fopen(path.c_str(), "r");
+    if(f == NULL) return false;
+
+    char line[256];
+    while(fgets(line, sizeof(line), f))
+    {
+        char name[128];
+        Hint h;
+        if(line[0] == '#' || sscanf(line, "%127s %d %d", name, &h.queue_size, &h.subcycle_size) != 3)
+            continue;
+
+        // cirque needs a power of 2, SubcycleAllocator whole 64 bit words
+        if(h.queue_size < 4 || h.queue_size > 65536 || (h.queue_size & (h.queue_size - 1)) ||
+           h.subcycle_size < 64 || h.subcycle_size % 64)
+            continue;
+
+        hints[name] = h;
+    }
+
+    fclose(f);
+    return true;
+}
+
+bool HintTable::save(const std::string& path, const char* game) const
+{
+    FILE* f = fopen(path.c_str(), "w");
+    if(f == NULL) return false;
+
+    fprintf(f, "# %s: event queue and sub-cycle sizes by chip instance (dice_headless --tune-hints)\n", game);
+    for(const auto& h : hints)
+        fprintf(f, "%s %d %d\n", h.first.c_str(), h.second.queue_size, h.second.subcycle_size);
+
+    return fclose(f) == 0;
+}
@@ -0,0 +1,39 @@
+#ifndef HINT_TABLE_H
+#define HINT_TABLE_H
+
+#include <map>
+#include <string>
+
+// Event queue and sub-cycle sizes for a game's chip instances, measured by
+// dice_headless --tune-hints (ChipProfiler::tuneHints()). When the game is
+// built with Settings::tuned_hints, an instance listed here gets these sizes
+// instead of the netlist's OPTIMIZATION_HINT or the defaults.
+//
+// File: text, one "instance queue_size subcycle_size" line per instance,
+// # starts a comment. Queue sizes are powers of 2, sub-cycle sizes multiples of 64.
+class HintTable
+{
+public:
+    struct Hint
+    {
+        int queue_size;
+        int subcycle_size;
+    };
+
+    std::map<std::string, Hint> hints; // By instance name, sub-circuit prefix included
+
+    const Hint* find(const std::string& instance) const
+    {
+        auto found = hints.find(instance);
+        return found == hints.end() ? nullptr : &found->second;
+    }
+
+    // false if path can't be read, entries that don't parse or have invalid sizes are skipped
+    bool load(const std::string& path);
+    bool save(const std::string& path, const char* game) const;
+
+    // Where the table of game is kept, under the configuration directory
+    static std::string defaultPath(const char* game);
+};
+
+#endif
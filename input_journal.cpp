@@ -0,0 +1,94 @@
+#include "input_journal.h"
+#include "circuit.h"
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+const char InputJournal::MAGIC[8] = { 'D','I','C','E','J','N','L','1' };
+
+InputJournal::InputJournal(const std::string& path, const char* game, uint32_t seed) :
+    replay(false), file(fopen(path.c_str(), "wb")), polls(0), misses(0), next_record(0)
+{
+    if(file == nullptr) throw std::runtime_error("InputJournal: cannot create " + path);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.seed = seed;
+    strncpy(header.game, game, sizeof(header.game) - 1);
+
+    // Rewritten with the end time when the recording finishes
+    fwrite(&header, sizeof(header), 1, file);
+}
+
+InputJournal::InputJournal(const std::string& path) :
+    replay(true), file(fopen(path.c_str(), "rb")), polls(0), misses(0), next_record(0)
+{
+    if(file == nullptr) throw std::runtime_error("InputJournal: cannot open " + path);
+
+    if(fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0)
+    {
+        fclose(file);
+        throw std::runtime_error("InputJournal: " + path + " is not an input journal");
+    }
+    header.game[sizeof(header.game) - 1] = 0;
+
+    Record r;
+    while(fread(&r, sizeof(r), 1, file) == 1) records.push_back(r);
+
+    fclose(file);
+    file = nullptr;
+}
+
+InputJournal::~InputJournal()
+{
+    if(file)
+    {
+        fseek(file, 0, SEEK_SET);
+        fwrite(&header, sizeof(header), 1, file);
+        fclose(file);
+    }
+}
+
+void InputJournal::set_current(uint32_t chip, double value)
+{
+    if(chip >= current.size()) current.resize(chip + 1, NAN);
+    current[chip] = value;
+}
+
+double InputJournal::poll(const Chip* chip, double value)
+{
+    const Circuit* circuit = chip->circuit;
+    if(circuit->speculative) return value;
+
+    uint64_t time = circuit->global_time;
+    polls++;
+
+    if(!replay)
+    {
+        header.end_time = time;
+
+        if(chip->index >= current.size() || !(current[chip->index] == value))
+        {
+            Record r = { time, chip->index, 0, value };
+            fwrite(&r, sizeof(r), 1, file);
+            set_current(chip->index, value);
+        }
+        return value;
+    }
+
+    // Changes of other chips polled at the same time may be applied early, they
+    // only take effect at their own poll
+    while(next_record < records.size() && records[next_record].time <= time)
+    {
+        set_current(records[next_record].chip, records[next_record].value);
+        next_record++;
+    }
+
+    if(chip->index >= current.size() || std::isnan(current[chip->index]))
+    {
+        misses++;
+        return value;
+    }
+    return current[chip->index];
+}
@@ -0,0 +1,78 @@
+#ifndef INPUT_JOURNAL_H
+#define INPUT_JOURNAL_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class Chip;
+
+// Journal of the values the input chips read, to reproduce a session. Each poll
+// (paddle position, button state, wheel movement, throttle position) goes through
+// poll(). While recording, a value that differs from the chip's previous one is
+// appended with its emulated time and chip index. On replay the input chips get
+// the journaled values instead of what the Input back-end says, so a session
+// played in the GUI can be rerun headless with null input.
+//
+// rand() drives the random clocks of some netlists (Anti-Aircraft, Steeplechase),
+// the journal keeps the seed: call srand(seed()) before building the circuit, both
+// when recording and replaying. DIP switches and potentiometers come from the
+// game's config file and aren't journaled. Replay reads the journal in order, so
+// loadState() and fork() aren't supported while replaying. Speculative frames
+// (RunAhead) are left out.
+//
+// File: header "DICEJNL1", uint32 seed, uint32 reserved, uint64 last poll time,
+// char game[32], then records of uint64 time, uint32 chip index, uint32 reserved,
+// double value. Little endian, times in Circuit units.
+class InputJournal
+{
+public:
+    InputJournal(const std::string& path, const char* game, uint32_t seed); // Records, throws if path can't be created
+    explicit InputJournal(const std::string& path);                         // Replays, throws if path isn't a journal
+    ~InputJournal();
+
+    // Value the input chip reads at this poll: value itself when recording,
+    // the journaled one when replaying
+    double poll(const Chip* chip, double value);
+
+    bool        replaying() const { return replay; }
+    uint32_t    seed() const { return header.seed; }
+    const char* game() const { return header.game; }
+    uint64_t    endTime() const { return header.end_time; } // Time of the last recorded poll
+    uint64_t    pollCount() const { return polls; }
+    uint64_t    missCount() const { return misses; }       // Replayed polls with no journaled value, read live
+
+    static const char MAGIC[8];
+
+private:
+    struct Header
+    {
+        char     magic[8];
+        uint32_t seed;
+        uint32_t reserved;
+        uint64_t end_time;
+        char     game[32];
+    };
+
+    struct Record
+    {
+        uint64_t time;
+        uint32_t chip;
+        uint32_t reserved;
+        double   value;
+    };
+
+    bool    replay;
+    FILE*   file;
+    Header  header;
+    uint64_t polls, misses;
+
+    std::vector<double> current;  // Last value of each chip, by Chip::index. NaN before the first one.
+    std::vector<Record> records;  // Whole journal when replaying
+    size_t next_record;
+
+    void set_current(uint32_t chip, double value);
+};
+
+#endif
@@ -16,10 +16,12 @@ using namespace phoenix;
 
 #include "globals.h"
 #include "circuit.h"
+#include "run_ahead.h"
 #include "circuit_desc.h"
 #include "game_list.h"
 
-#include "chips/input.h"
+#include "chips/input_sdl.h"
+#include "chips/audio_sdl.h"
 #include "ui/audio_window.h"
 #include "ui/video_window.h"
 #include "ui/input_window.h"
@@ -44,13 +46,16 @@ struct MainWindow : Window
     Settings settings;
     Input*   input;
     Video*   video;
+    Audio*   audio;
     Circuit* circuit;
+    RunAhead* run_ahead;
     RealTimeClock real_time;
 
     /* ==== state‑dump begin ==================================== */
     std::string dump_path;             // empty  ⇒ recording off
     SampleMode  smode = SampleMode::Tick;
     /* ==== state‑dump end   ==================================== */
+    std::string journal_path;          // empty  ⇒ input not journaled
 
     /* ---------- UI objects ---------- */
     Menu game_menu;
@@ -96,7 +101,9 @@ struct MainWindow : Window
     MainWindow()
     : input(nullptr)
     , video(nullptr)
+    , audio(nullptr)
     , circuit(nullptr)
+    , run_ahead(nullptr)
     , prev_ui_state{false,false,false,false}
     , audio_window(settings, mute_item)
     , video_window(settings, *this)
@@ -127,14 +134,7 @@ struct MainWindow : Window
         game_window.start_button.onActivate = [&]
         {
             GameDesc& g = game_list[game_window.game_view.selection()];
-            if(circuit) delete circuit;
-
-            /* ==== state‑dump begin */
-            circuit = new Circuit(
-                settings, *input, *video,
-                g.desc, g.command_line,
-                dump_path, smode);
-            /* ==== state‑dump end   */
+            startGame(g);
 
             game_window.setModal(false);
             game_window.setVisible(false);
@@ -145,7 +145,7 @@ struct MainWindow : Window
 
         end_game_item.setText("End Game");
         end_game_item.onActivate = [&]{
-            if(circuit){ delete circuit; circuit = nullptr; }
+            endGame();
             onSize();
         };
         game_menu.append(end_game_item);
@@ -272,7 +272,7 @@ struct MainWindow : Window
             exit(1);
         }
 
-        input = new Input();
+        input = new InputSdl();
         video = Video::createDefault(layout, viewport);
 
         onSize = [&]{
@@ -312,13 +312,43 @@ struct MainWindow : Window
     ~MainWindow()
     {
         settings.save();
-        if(circuit) delete circuit;
+        endGame();
         delete video;
         delete viewport;
         delete input;
         SDL_Quit();
     }
 
+    /*----------------------------------------------------------------
+        Helper: startGame / endGame
+    ----------------------------------------------------------------*/
+    void startGame(const GameDesc& g)
+    {
+        endGame();
+
+        /* ==== state‑dump begin */
+        // Replaying the journal needs the same rand() sequence
+        uint32_t seed = time(nullptr);
+        srand(seed);
+
+        audio   = new AudioSdl();
+        circuit = new Circuit(
+            settings, *input, *video, *audio,
+            g.desc, g.command_line,
+            dump_path, smode);
+        /* ==== state‑dump end   */
+        if(!journal_path.empty())
+            circuit->journal.reset(new InputJournal(journal_path, g.command_line, seed));
+        run_ahead = new RunAhead(*circuit);
+    }
+
+    void endGame()
+    {
+        if(run_ahead){ delete run_ahead; run_ahead = nullptr; }
+        if(circuit){ delete circuit; circuit = nullptr; }
+        if(audio){ delete audio; audio = nullptr; }
+    }
+
     /*----------------------------------------------------------------
         Helper: toggleFullscreen
     ----------------------------------------------------------------*/
@@ -389,7 +419,13 @@ struct MainWindow : Window
 
         if(circuit && !settings.pause)
         {
-            circuit->run(2.5e-3 / Circuit::timescale);
+            // Run-ahead works a whole frame at a time, recording needs every event
+            if(settings.run_ahead && !circuit->recorder)
+            {
+                run_ahead->frames = settings.run_ahead;
+                run_ahead->run_frame(0.1 / Circuit::timescale);
+            }
+            else circuit->run(2.5e-3 / Circuit::timescale);
 
             uint64_t emu = circuit->global_time * 1000000.0 * Circuit::timescale;
 
@@ -401,7 +437,16 @@ struct MainWindow : Window
 
             if(real_time.get_usecs() > 1000000)
             {
-                setStatusText({"FPS: ", circuit->video.frame_count});
+                if(settings.run_ahead && run_ahead->sampleCount())
+                {
+                    char readout[80];
+                    snprintf(readout, sizeof(readout), "  Run-ahead %.1f ms, lag %.1f ms, cost %.1f ms",
+                             run_ahead->ahead() * 1000.0, run_ahead->latency() * 1000.0, run_ahead->overhead() * 1000.0);
+                    setStatusText({"FPS: ", circuit->video.frame_count, readout});
+                }
+                else
+                    setStatusText({"FPS: ", circuit->video.frame_count});
+                run_ahead->reset_stats();
                 circuit->video.frame_count = 0;
                 real_time += 1000000;
             }
@@ -468,6 +513,10 @@ int main(int argc, char** argv)
                 main_window.dump_path = argv[++i];
                 main_window.smode     = SampleMode::FrameEdge;
             }
+            else if(strcmp(argv[i], "-runahead") == 0 && i+1<argc)
+                main_window.settings.run_ahead = atoi(argv[++i]);
+            else if(strcmp(argv[i], "-record") == 0 && i+1<argc)
+                main_window.journal_path = argv[++i];
         }
     }
 
@@ -481,14 +530,7 @@ int main(int argc, char** argv)
                 if(start_fullscreen)
                     main_window.toggleFullscreen(true);
 
-                main_window.circuit = new Circuit(
-                    main_window.settings,
-                    *main_window.input,
-                    *main_window.video,
-                    g.desc,
-                    g.command_line,
-                    main_window.dump_path,
-                    main_window.smode);
+                main_window.startGame(g);
 
                 main_window.onSize();
                 break;
@@ -0,0 +1,193 @@
+#include <nall/platform.hpp>
+#include <nall/directory.hpp>
+
+#include "netlist_image.h"
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace nall;
+
+// in main.cpp
+extern const nall::string& application_path();
+
+const char NetlistImage::MAGIC[8] = { 'D','I','C','E','N','L','I','1' };
+
+static void stamp_add(uint64_t& hash, const void* data, size_t size)
+{
+    // FNV-1a
+    const uint8_t* p = (const uint8_t*)data;
+    for(size_t i = 0; i < size; i++)
+        hash = (hash ^ p[i]) * 0x100000001b3ull;
+}
+
+static bool stamp_file(uint64_t& hash, const char* path)
+{
+    struct stat st;
+    if(stat(path, &st) != 0) return false;
+
+    uint64_t id[3] = { uint64_t(st.st_ino), uint64_t(st.st_size), uint64_t(st.st_mtime) };
+    stamp_add(hash, id, sizeof(id));
+    return true;
+}
+
+uint64_t NetlistImage::stamp()
+{
+    // Neither changes while running in practice, computed once
+    static std::once_flag once;
+    static uint64_t hash;
+
+    std::call_once(once, []()
+    {
+        hash = 0xcbf29ce484222325ull;
+        uint32_t version = VERSION;
+        stamp_add(hash, &version, sizeof(version));
+
+        if(!stamp_file(hash, "/proc/self/exe"))
+        {
+            hash = 0;
+            return;
+        }
+
+        // Same places RomDesc looks in. Adding, removing or replacing a ROM changes the stamp.
+        const char* rom_dirs[] = { "roms/", "../../roms/" };
+        for(const char* d : rom_dirs)
+        {
+            string dir = {application_path(), d};
+            stamp_add(hash, dir.data(), dir.length() + 1);
+
+            for(const string& f : directory::files(dir, "*.zip"))
+            {
+                string path = {dir, f};
+                stamp_add(hash, path.data(), path.length() + 1);
+                stamp_file(hash, path);
+            }
+        }
+    });
+
+    return hash;
+}
+
+const char* NetlistImage::executable()
+{
+    static std::once_flag once;
+    static char name[64];
+
+    std::call_once(once, []()
+    {
+        char path[4096];
+        ssize_t n = readlink("/proc/self/exe", path, sizeof(path) - 1);
+        path[n > 0 ? n : 0] = 0;
+
+        const char* base = strrchr(path, '/');
+        snprintf(name, sizeof(name), "%.63s", base && base[1] ? base + 1 : n > 0 ? path : "dice");
+    });
+
+    return name;
+}
+
+std::string NetlistImage::defaultPath(const char* game)
+{
+    string dir = {configpath(), "dice/netlists/"};
+    directory::create(dir);
+
+    // One image per executable, each stamps its own
+    return std::string(dir.data()) + game + "." + executable() + ".dnl";
+}
+
+bool NetlistImage::valid(const char* game) const
+{
+    if(size < sizeof(Header)) return false;
+
+    const Header& h = header();
+    if(memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 || h.version != VERSION ||
+       h.stamp == 0 || h.stamp != stamp() ||
+       strncmp(h.game, game, sizeof(h.game)) != 0 || h.game[sizeof(h.game) - 1] != 0)
+        return false;
+
+    if(size != sizeof(Header) + uint64_t(h.chip_count) * sizeof(ChipRecord) +
+               uint64_t(h.link_count) * sizeof(LinkRecord) + uint64_t(h.lut_words) * sizeof(uint32_t))
+        return false;
+
+    // Links have to add up and point at chips, sources be increasing
+    uint64_t link_total = 0;
+    for(uint32_t i = 0; i < h.chip_count; i++)
+    {
+        const ChipRecord& c = chips()[i];
+        if(c.source >= h.source_count || (i > 0 && c.source <= chips()[i - 1].source)) return false;
+        link_total += c.output_count + c.input_count;
+    }
+    if(link_total != h.link_count) return false;
+
+    for(uint32_t i = 0; i < h.link_count; i++)
+        if(links()[i].chip >= h.chip_count && links()[i].chip != NO_CHIP) return false;
+
+    return true;
+}
+
+const NetlistImage* NetlistImage::open(const std::string& path, const char* game)
+{
+    if(stamp() == 0) return NULL;
+
+    // Images stay mapped, their LUTs are in LutPool
+    static std::mutex mutex;
+    static std::map<std::string, NetlistImage*> mapped;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto found = mapped.find(path);
+    if(found != mapped.end()) return found->second->valid(game) ? found->second : NULL;
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) return NULL;
+
+    struct stat st;
+    void* map = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(Header))
+        map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(map == MAP_FAILED) return NULL;
+
+    NetlistImage* image = new NetlistImage((const uint8_t*)map, st.st_size);
+    if(!image->valid(game))
+    {
+        munmap(map, st.st_size);
+        delete image;
+        return NULL;
+    }
+
+    mapped[path] = image;
+    return image;
+}
+
+bool NetlistImage::write(const std::string& path, const Header& header, const ChipRecord* chips,
+                         const LinkRecord* links, const uint32_t* luts)
+{
+    if(header.stamp == 0) return false;
+
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%d.tmp", int(getpid()));
+    std::string tmp_path = path + suffix;
+
+    FILE* f = fopen(tmp_path.c_str(), "wb");
+    if(f == NULL) return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(chips, sizeof(ChipRecord), header.chip_count, f) == header.chip_count &&
+              fwrite(links, sizeof(LinkRecord), header.link_count, f) == header.link_count &&
+              fwrite(luts, sizeof(uint32_t), header.lut_words, f) == header.lut_words;
+
+    ok = fclose(f) == 0 && ok;
+    ok = ok && rename(tmp_path.c_str(), path.c_str()) == 0;
+
+    if(!ok) remove(tmp_path.c_str());
+    return ok;
+}
@@ -0,0 +1,96 @@
+#ifndef NETLIST_IMAGE_H
+#define NETLIST_IMAGE_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+
+// Circuit as it is once built: which of the netlist's chips survived pruning,
+// their links and LUTs. Building the netlist (resolving connections by name,
+// pruning, filling ROM LUTs) is most of the startup time of a game, loading
+// the image skips it. Circuit writes one after building a game from scratch
+// and maps it the next time the game is built (Settings::netlist_images).
+//
+// Chips are stored by creation number, the order Circuit creates them in from
+// the game's CircuitDesc (special chips, then each instance's sub-chips), so
+// descriptors, custom logic and custom_data are looked up again in the running
+// executable instead of being stored as pointers. LUTs are mapped from the file
+// and handed to LutPool. An image is only used by the executable that wrote it
+// with the ROM files that were present then, see stamp().
+//
+// File: Header, then ChipRecord for each chip, then LinkRecord for each chip's
+// output links followed by its input links, then the BASIC_CHIP LUT words.
+// Little endian, 8 byte aligned sections.
+class NetlistImage
+{
+public:
+    struct Header
+    {
+        char     magic[8];
+        uint32_t version;
+        uint32_t chip_count;   // Chips kept
+        uint32_t source_count; // Chips created before pruning
+        uint32_t removed;      // Chips pruned
+        uint32_t link_count;
+        uint32_t lut_words;
+        uint64_t stamp;
+        char     game[32];
+    };
+
+    struct ChipRecord
+    {
+        uint32_t source;       // Creation number
+        uint32_t output_count;
+        uint32_t input_count;
+        uint32_t reserved;
+        uint64_t active_outputs;
+        uint64_t lut;          // lut_data of a SIMPLE_CHIP, offset in LUT words of a BASIC_CHIP
+    };
+
+    struct LinkRecord
+    {
+        uint32_t chip;         // Index of the linked chip, NO_CHIP if unconnected
+        uint32_t reserved;
+        uint64_t mask;
+    };
+
+    static const uint32_t NO_CHIP = 0xffffffff;
+
+    // Image of game at path, mapped for the rest of the process. NULL if there is
+    // none or it was written by another executable, with other ROMs, or for another game.
+    static const NetlistImage* open(const std::string& path, const char* game);
+
+    // Writes the image to a temporary file renamed to path, so processes building
+    // the same game concurrently never see a partial one. false on failure.
+    static bool write(const std::string& path, const Header& header, const ChipRecord* chips,
+                      const LinkRecord* links, const uint32_t* luts);
+
+    // Where the image of game is kept, under the configuration directory. Named
+    // after the executable too: dice, dice_headless, dice_bench... each have a
+    // different stamp() and would otherwise replace each other's images.
+    static std::string defaultPath(const char* game);
+
+    // File name of the running executable
+    static const char* executable();
+
+    // Identity of the running executable and of the ROM files, 0 if it can't be
+    // determined (images are then neither read nor written)
+    static uint64_t stamp();
+
+    const Header&     header() const { return *(const Header*)data; }
+    const ChipRecord* chips() const  { return (const ChipRecord*)(data + sizeof(Header)); }
+    const LinkRecord* links() const  { return (const LinkRecord*)(chips() + header().chip_count); }
+    const uint32_t*   luts() const   { return (const uint32_t*)(links() + header().link_count); }
+
+    static const char MAGIC[8];
+    static const uint32_t VERSION = 1;
+
+private:
+    const uint8_t* data;
+    size_t size;
+
+    NetlistImage(const uint8_t* d, size_t s) : data(d), size(s) { }
+    bool valid(const char* game) const;
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include "optimizer_verifier.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+// Emulated time between chip comparisons while locating a divergence
+static const uint64_t LOCATE_STEP = 100000; // 100 ns
+
+static OptimizerVerifier::Snapshot snapshot(const Chip* c)
+{
+    return { c->inputs, c->output, int(c->state), c->optimization_disabled, c->pending_event, c->last_output_event };
+}
+
+static const char* state_name(int state)
+{
+    switch(state)
+    {
+        case PASSIVE: return "PASSIVE";
+        case ACTIVE:  return "ACTIVE";
+        case ASLEEP:  return "ASLEEP";
+        default:      return "?";
+    }
+}
+
+OptimizerVerifier::OptimizerVerifier(const Settings& settings, Input& input, const CircuitDesc* desc, const char* name, uint32_t s) :
+    seed(s), frames(0), compared(0), asleep(0), diverged()
+{
+    diverged.chip = diverged.span = -1;
+
+    srand(seed);
+    optimized.reset(new Circuit(settings, input, optimized_video, audio, desc, name));
+
+    srand(seed);
+    reference.reset(new Circuit(settings, input, reference_video, audio, desc, name));
+    for(Chip* c : reference->chips)
+        c->optimization_disabled = true;
+}
+
+bool OptimizerVerifier::step(int64_t max_time)
+{
+    if(diverged.found) return false;
+
+    optimized_start = optimized->saveState();
+    reference_start = reference->saveState();
+
+    srand(seed + frames + 1);
+    bool completed = optimized->run_frame(max_time);
+
+    srand(seed + frames + 1);
+    if(reference->run_frame(max_time) != completed)
+        completed = false;
+    else if(!completed)
+        return false;
+
+    frames++;
+    if(!compare())
+    {
+        locate();
+        return false;
+    }
+
+    return completed;
+}
+
+bool OptimizerVerifier::compare()
+{
+    Divergence& d = diverged;
+    d.frame = frames;
+    d.time = optimized->global_time;
+    d.reference_time = reference->global_time;
+
+    const std::vector<VideoSpans::Span>& spans = optimized_video.frame();
+    const std::vector<VideoSpans::Span>& reference_spans = reference_video.frame();
+    for(size_t i = 0; i < std::max(spans.size(), reference_spans.size()); i++)
+    {
+        VideoSpans::Span none = {};
+        const VideoSpans::Span& a = i < spans.size() ? spans[i] : none;
+        const VideoSpans::Span& b = i < reference_spans.size() ? reference_spans[i] : none;
+        if(a != b)
+        {
+            d.span = i;
+            d.optimized_span = a;
+            d.reference_span = b;
+            break;
+        }
+    }
+
+    d.chips = compareChips(std::min(d.time, d.reference_time), d, compared, asleep);
+
+    d.found = d.time != d.reference_time || d.span >= 0 || d.chips;
+    return !d.found;
+}
+
+void OptimizerVerifier::locate()
+{
+    Divergence& d = diverged;
+    uint64_t end = std::min(d.time, d.reference_time);
+
+    optimized->loadState(optimized_start);
+    reference->loadState(reference_start);
+
+    // rand() is seeded for each step, calls from the two circuits would interleave otherwise
+    uint64_t ignored = 0;
+    for(uint64_t step = 1, time = optimized->global_time + LOCATE_STEP; time < end; step++, time += LOCATE_STEP)
+    {
+        srand(seed + frames + step);
+        if(int64_t(time - optimized->global_time) > 0) optimized->run(time - optimized->global_time);
+
+        srand(seed + frames + step);
+        if(int64_t(time - reference->global_time) > 0) reference->run(time - reference->global_time);
+
+        // run() ends with the first event past time, one circuit may be ahead
+        Divergence found = d;
+        found.chip = -1;
+        if((found.chips = compareChips(std::min(optimized->global_time, reference->global_time), found, ignored, ignored)))
+        {
+            found.located_time = time;
+            d = found;
+            return;
+        }
+    }
+}
+
+unsigned OptimizerVerifier::compareChips(uint64_t time, Divergence& d, uint64_t& compared, uint64_t& asleep) const
+{
+    unsigned chips = 0;
+    for(size_t i = 0; i < optimized->chips.size(); i++)
+    {
+        const Chip* a = optimized->chips[i];
+        const Chip* b = reference->chips[i];
+
+        if(a->state == ASLEEP)
+        {
+            asleep++;
+            continue;
+        }
+
+        if(a->pending_event == time || a->last_output_event >= time ||
+           b->pending_event == time || b->last_output_event >= time)
+            continue;
+
+        compared++;
+        if(a->output == b->output) continue;
+
+        // Its output changed in one circuit and not the other at the later of the last changes
+        uint64_t parted = std::max(a->last_output_event, b->last_output_event);
+        if(chips++ == 0 || parted < d.chip_time)
+        {
+            d.chip = i;
+            d.chip_time = parted;
+            d.optimized = snapshot(a);
+            d.reference = snapshot(b);
+        }
+    }
+
+    return chips;
+}
+
+void OptimizerVerifier::report(FILE* f, const char* game) const
+{
+    const Divergence& d = diverged;
+
+    fprintf(f, "%s: %u frames verified, %llu chip outputs compared, %llu skipped asleep\n", game, frames - d.found,
+            (unsigned long long)compared, (unsigned long long)asleep);
+    if(!d.found) return;
+
+    fprintf(f, "Diverged in frame %u:\n", d.frame);
+    if(d.time != d.reference_time)
+        fprintf(f, "  frame ended at %.9f s, %.9f s without optimizer\n", d.time * Circuit::timescale,
+                d.reference_time * Circuit::timescale);
+
+    if(d.chip >= 0)
+    {
+        const std::vector<std::string>& names = optimized->tables->chip_names;
+        char at[32] = "the frame edge";
+        if(d.located_time) snprintf(at, sizeof(at), "%.9f s", d.located_time * Circuit::timescale);
+
+        fprintf(f, "  %u chip outputs differ at %s, first %s at %.9f s\n", d.chips, at,
+                size_t(d.chip) < names.size() ? names[d.chip].c_str() : "?", d.chip_time * Circuit::timescale);
+
+        const Snapshot* s[] = { &d.optimized, &d.reference };
+        const char* label[] = { "optimized", "reference" };
+        for(int i = 0; i < 2; i++)
+            fprintf(f, "  %-10s out %d in %#x %-7s%s pending %.9f s, last change %.9f s\n", label[i], s[i]->output,
+                    s[i]->inputs, state_name(s[i]->state), s[i]->optimization_disabled ? " (disabled)" : "",
+                    s[i]->pending_event * Circuit::timescale, s[i]->last_output_event * Circuit::timescale);
+    }
+
+    if(d.span >= 0)
+    {
+        const VideoSpans::Span* s[] = { &d.optimized_span, &d.reference_span };
+        const char* label[] = { "optimized", "reference" };
+        fprintf(f, "  video span %d differs\n", d.span);
+        for(int i = 0; i < 2; i++)
+            fprintf(f, "  %-10s line %u, %.3f-%.3f us, value %#x\n", label[i], s[i]->line,
+                    s[i]->start * Circuit::timescale * 1.0e6, s[i]->end * Circuit::timescale * 1.0e6, s[i]->value);
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef OPTIMIZER_VERIFIER_H
+#define OPTIMIZER_VERIFIER_H
+
+#include <cstdio>
+#include <memory>
+
+#include "circuit.h"
+#include "chips/audio_null.h"
+#include "chips/video_spans.h"
+
+// Checks the cycle optimizer against plain event simulation. A game is built
+// twice and run in lockstep, once as it is and once with optimization_disabled
+// on every chip, so only update_inputs_simple() runs. At every frame edge both
+// must be at the same time, have drawn the same video spans and have the same
+// output on every chip. Chips ASLEEP are skipped, their output catches up when
+// they wake, as are chips changing at the frame edge's own time: events at one
+// time don't run in the same order in both.
+//
+// A divergence is then located: both circuits are loaded from the frame's start
+// and stepped LOCATE_STEP at a time, comparing chips after each step, to find
+// the first chip to differ. A difference that comes and goes within a step
+// (a chip changing a few ns late) is only seen in the video spans.
+//
+// settings must have copy_custom_data set. Both circuits share input and seed
+// rand() the same way before each frame.
+class OptimizerVerifier
+{
+public:
+    // What a chip was doing when its outputs were compared
+    struct Snapshot
+    {
+        int inputs, output;
+        int state; // ChipState
+        bool optimization_disabled;
+        uint64_t pending_event, last_output_event;
+    };
+
+    struct Divergence
+    {
+        bool found;
+        uint32_t frame;
+        uint64_t time, reference_time; // Frame edge, in each circuit
+
+        // Of the chips with different outputs, the first to part from the common
+        // history (the later of its last changes in the two is earliest), -1 if none
+        int chip;
+        unsigned chips;
+        uint64_t chip_time;    // When it parted
+        uint64_t located_time; // Step they were found at, 0 if only at the frame edge
+        Snapshot optimized, reference;
+
+        // First video span of the frame that differs, -1 if none
+        int span;
+        VideoSpans::Span optimized_span, reference_span;
+    };
+
+    OptimizerVerifier(const Settings& settings, Input& input, const CircuitDesc* desc, const char* name, uint32_t seed = 0);
+
+    // One frame of both circuits, false once they diverge or max_time passes without a VBLANK
+    bool step(int64_t max_time);
+
+    const Circuit& circuit() const { return *optimized; }
+    const Divergence& divergence() const { return diverged; }
+    uint32_t frameCount() const { return frames; }
+    uint64_t comparedCount() const { return compared; } // Chip outputs compared
+    uint64_t asleepCount() const { return asleep; }     // ... and skipped because the chip was asleep
+
+    void report(FILE* f, const char* game) const;
+
+private:
+    AudioNull audio;
+    VideoSpans optimized_video, reference_video;
+    std::unique_ptr<Circuit> optimized, reference;
+
+    uint32_t seed;
+    uint32_t frames;
+    uint64_t compared, asleep;
+    Divergence diverged;
+    nall::serializer optimized_start, reference_start; // States at the start of the frame
+
+    bool compare();
+    void locate();
+
+    // Chips with different outputs at time, into d. Chips changing at or after
+    // time in either circuit are skipped.
+    unsigned compareChips(uint64_t time, Divergence& d, uint64_t& compared, uint64_t& asleep) const;
+};
+
+#endif
@@ -0,0 +1,52 @@
+#include "run_ahead.h"
+
+void RunAhead::reset_stats()
+{
+    samples = 0;
+    total_latency = total_ahead = total_overhead = 0.0;
+}
+
+bool RunAhead::run_frame(int64_t max_time)
+{
+    bool run_ahead = frames > 0 && !circuit.recorder;
+
+    circuit.input.poll_input();
+    uint64_t poll_time = clock.get_usecs();
+
+    circuit.video.visible = !run_ahead;
+    bool completed = circuit.run_frame(max_time);
+    circuit.video.visible = true;
+
+    if(!completed) return false;
+
+    uint64_t lookahead_time = clock.get_usecs();
+    uint64_t real_time = circuit.global_time;
+    double shown_ahead = 0.0;
+
+    if(run_ahead)
+    {
+        nall::serializer state = circuit.saveState();
+
+        // Not throttled, no sound, only the last frame is drawn
+        circuit.speculative = true;
+        for(unsigned i = 0; i < frames; i++)
+        {
+            circuit.video.visible = (i == frames - 1);
+            if(!circuit.run_frame(max_time)) break;
+        }
+        circuit.video.visible = true;
+        circuit.speculative = false;
+
+        shown_ahead = (circuit.global_time - real_time) * Circuit::timescale;
+        circuit.loadState(state);
+    }
+
+    // The shown frame is presented at its VBLANK, the end of the last run
+    uint64_t present_time = run_ahead ? clock.get_usecs() : lookahead_time;
+
+    samples++;
+    total_latency += (present_time - poll_time) * 1.0e-6 - shown_ahead;
+    total_ahead += shown_ahead;
+    total_overhead += (clock.get_usecs() - lookahead_time) * 1.0e-6;
+    return true;
+}
@@ -0,0 +1,38 @@
+#ifndef RUN_AHEAD_H
+#define RUN_AHEAD_H
+
+#include "circuit.h"
+#include "realtime.h"
+
+// Run-ahead latency reduction for interactive play. Each host frame polls the
+// input and emulates one frame without drawing it, then saves the circuit,
+// runs `frames` more frames with the same input, shows only the last one and
+// loads the saved state back. The picture is that many frames newer than the
+// emulation, for the cost of the extra frames plus a save and a load.
+// Not used while the circuit records a state dump.
+class RunAhead
+{
+public:
+    RunAhead(Circuit& c, unsigned f = 1) : frames(f), circuit(c) { reset_stats(); }
+
+    unsigned frames; // 0 runs the circuit normally, still measuring latency
+
+    // One host frame. false if max_time passed without a VBLANK.
+    bool run_frame(int64_t max_time);
+
+    // Readout, averaged over the frames since reset_stats(), in seconds
+    unsigned sampleCount() const { return samples; }
+    double latency() const { return samples ? total_latency / samples : 0.0; }   // Input poll to display, less the time shown ahead
+    double ahead() const { return samples ? total_ahead / samples : 0.0; }       // Emulated time the picture is ahead
+    double overhead() const { return samples ? total_overhead / samples : 0.0; } // Host time spent on save, lookahead and load
+    void reset_stats();
+
+private:
+    Circuit& circuit;
+    RealTimeClock clock;
+
+    unsigned samples;
+    double total_latency, total_ahead, total_overhead;
+};
+
+#endif
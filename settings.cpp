@@ -120,7 +120,7 @@ void Settings::appendKey(KeyAssignment& k, string name)
     append(k.joystick, string{name, ".joystick"});
 }
 
-Settings::Settings() : num_mice(0), pause(false), throttle(true), fullscreen(false)
+Settings::Settings() : num_mice(0), pause(false), throttle(true), fullscreen(false), copy_custom_data(false)
 {
     append(audio.frequency = Audio::Frequency::FREQ_48000, "audio.frequency");
     append(audio.volume = 500, "audio.volume");
@@ -131,6 +131,12 @@ Settings::Settings() : num_mice(0), pause(false), throttle(true), fullscreen(fal
     append(video.multisampling = Video::FOUR_X, "video.multisampling");
     append(video.vsync = false, "video.vsync");
 
+    append(event_queue = HEAP_QUEUE, "event_queue");
+    append(run_ahead = 0, "run_ahead");
+    append(netlist_images = true, "netlist_images");
+    append(tuned_hints = true, "tuned_hints");
+    append(adaptive_optimization = true, "adaptive_optimization");
+
     // Paddles
     unsigned num = 1;
     for(Input::Paddle& paddle : input.paddle)
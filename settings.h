@@ -32,6 +32,30 @@ struct Settings : configuration
 
     bool pause, throttle;
     bool fullscreen;
+
+    // Events due at the same time are dispatched in a different order by the two
+    // queues (see CalendarQueue), games sensitive to it (Shark JAWS, Stunt Cycle) draw differently.
+    // The heap stays the default, the calendar queue isn't faster overall.
+    enum EventQueue { HEAP_QUEUE = 0, CALENDAR_QUEUE };
+    unsigned event_queue;
+
+    // Give each Circuit private copies of chip custom_data instead of using
+    // the game's static descriptors. Needed to run several instances of a game.
+    bool copy_custom_data;
+
+    unsigned run_ahead; // Frames emulated ahead of the real one to cut input lag (RunAhead), 0 = off
+
+    // Build games from a netlist image kept in the configuration directory, written
+    // the first time a game is built (NetlistImage)
+    bool netlist_images;
+
+    // Size chip event queues from the table written by dice_headless --tune-hints, if
+    // the game has one, instead of the netlist's OPTIMIZATION_HINTs (HintTable)
+    bool tuned_hints;
+
+    // Disable the cycle optimizer at run time for chips where looking for cycles costs
+    // more than the cycles save, and retry it later (Chip::review_optimization)
+    bool adaptive_optimization;
     
     struct Audio
     {
@@ -1,28 +1,606 @@
-// DICE State‑Dump Support  © 2025
+// DICE State‑Dump Support  © 2025
 #include "state_dump.h"
 #include "chip.h"
 #include <algorithm>
+#include <cstring>
+#include <stdexcept>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static inline uint8_t* put_varint(uint8_t* p, uint64_t v)
+{
+  while(v >= 0x80) {
+    *p++ = uint8_t(v) | 0x80;
+    v >>= 7;
+  }
+  *p++ = uint8_t(v);
+  return p;
+}
+
+static inline uint8_t* put_u64(uint8_t* p, uint64_t v)
+{
+  for(int b = 0; b < 8; b++) *p++ = uint8_t(v >> (8 * b));
+  return p;
+}
+
+static inline uint8_t* put_u32(uint8_t* p, uint32_t v)
+{
+  for(int b = 0; b < 4; b++) *p++ = uint8_t(v >> (8 * b));
+  return p;
+}
+
+static uint32_t get_u32(const uint8_t* b)
+{
+  return uint32_t(b[0]) | uint32_t(b[1]) << 8 | uint32_t(b[2]) << 16 | uint32_t(b[3]) << 24;
+}
+
+/*---------------------------------------------------------------------------
+ *  StateRecorder
+ *-------------------------------------------------------------------------*/
 StateRecorder::StateRecorder(const std::string& file,
                              unsigned chip_count,
-                             SampleMode mode)
+                             SampleMode mode,
+                             DumpFormat format,
+                             unsigned keyframe_interval)
 : out_(file, std::ios::binary)
 , row_((chip_count + 7) >> 3, 0)
 , mode_(mode)
+, format_(format)
+, started_(false)
+, prev_(chip_count, 0)
+, dt_table_(DELTA_DUMP_TABLE_SIZE, 0)
+, prev_time_(0)
+, keyframe_interval_(std::max(keyframe_interval, 1u))
+, since_keyframe_(0)
+, fill_pos_(0)
+, drain_size_(0)
+, drain_pending_(false)
+, quit_(false)
+, failed_(false)
 {
   if(!out_) throw std::runtime_error("StateRecorder: cannot open " + file);
+
+  /* Room for a full chunk plus the largest record */
+  fill_.resize(CHUNK_SIZE + 16 + 6 * chip_count);
+  drain_.resize(fill_.size());
+
+  if(format_ == DumpFormat::Delta) {
+    uint8_t* p = std::copy(DELTA_DUMP_MAGIC, DELTA_DUMP_MAGIC + sizeof DELTA_DUMP_MAGIC, fill_.data());
+    p = put_u32(p, chip_count);
+    p = put_u32(p, keyframe_interval_);
+    fill_pos_ = p - fill_.data();
+  }
+
+  writer_ = std::thread(&StateRecorder::writer, this);
 }
 
-StateRecorder::~StateRecorder() { out_.close(); }
+StateRecorder::~StateRecorder()
+{
+  hand_off();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  cond_.notify_all();
+  writer_.join();
+
+  out_.close();
+}
+
+void StateRecorder::writer()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  for(;;) {
+    cond_.wait(lock, [this]{ return drain_pending_ || quit_; });
+    if(!drain_pending_) return;
+
+    /* drain_ belongs to this thread until drain_pending_ is cleared */
+    lock.unlock();
+    out_.write(reinterpret_cast<const char*>(drain_.data()), drain_size_);
+    if(!out_) failed_ = true;
+    lock.lock();
+
+    drain_pending_ = false;
+    cond_.notify_all();
+  }
+}
+
+/* Swap the filled chunk for the drained one, waiting if the writer is behind */
+void StateRecorder::hand_off()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.wait(lock, [this]{ return !drain_pending_; });
+
+  fill_.swap(drain_);
+  drain_size_ = fill_pos_;
+  fill_pos_ = 0;
+  if(fill_.size() < drain_.size()) fill_.resize(drain_.size());
+  drain_pending_ = true;
+  lock.unlock();
+  cond_.notify_all();
+}
+
+void StateRecorder::flip(uint32_t chip, uint8_t bit)
+{
+  prev_[chip] = bit;
+  row_[chip >> 3] ^= 1u << (chip & 7);
+  flipped_.push_back(chip);
+}
+
+template <class High>
+void StateRecorder::scan(std::size_t n, High high)
+{
+  for(std::size_t i = 0; i < n; ++i) {
+    uint8_t bit = high(i);
+    if(bit != prev_[i])
+      flip(uint32_t(i), bit);
+  }
+  started_ = true;
+}
 
 void StateRecorder::sample(uint64_t t, const std::vector<Chip*>& chips)
 {
-  std::fill(row_.begin(), row_.end(), 0);
+  flipped_.clear();
+  scan(chips.size(), [&chips](std::size_t i) { return chips[i]->output == 1; });   // 1 = logic‑high
+  write(t);
+}
+
+void StateRecorder::sample(uint64_t t, const std::vector<Chip*>& chips,
+                           const std::vector<uint32_t>& touched)
+{
+  flipped_.clear();
+
+  if(!started_)
+    scan(chips.size(), [&chips](std::size_t i) { return chips[i]->output == 1; });
+  else {
+    for(uint32_t c : touched) {
+      uint8_t bit = chips[c]->output == 1;
+      if(bit != prev_[c])
+        flip(c, bit);
+    }
+
+    if(flipped_.size() > 1)
+      std::sort(flipped_.begin(), flipped_.end());
+  }
+
+  write(t);
+}
+
+void StateRecorder::sample(uint64_t t, const std::vector<uint8_t>& outputs)
+{
+  flipped_.clear();
+  scan(outputs.size(), [&outputs](std::size_t i) { return outputs[i] == 1; });
+  write(t);
+}
+
+/* Encode the sample; row_ and flipped_ are up to date */
+void StateRecorder::write(uint64_t t)
+{
+  /* Worst case: header, time and a 5 byte varint per flipped chip */
+  std::size_t worst = 1 + 10 + row_.size() + 5 * flipped_.size();
+  if(fill_pos_ + worst > fill_.size()) fill_.resize(fill_pos_ + worst);
+  uint8_t* p = fill_.data() + fill_pos_;
+
+  if(format_ == DumpFormat::Raw) {
+    p = put_u64(p, t);
+    p = std::copy(row_.begin(), row_.end(), p);
+  }
+  else if(since_keyframe_ == 0) {
+    /* Keyframe: absolute time + full bitmap */
+    std::fill(dt_table_.begin(), dt_table_.end(), 0);
+
+    p = put_varint(p, 1);
+    p = put_u64(p, t);
+    p = std::copy(row_.begin(), row_.end(), p);
+  }
+  else {
+    /* Delta: usually one chip or none flipped since the last event */
+    uint64_t dt   = t - prev_time_;
+    unsigned slot = delta_dump_slot(dt);
+    bool cached   = dt_table_[slot] == dt;
+
+    p = put_varint(p, uint64_t(flipped_.size()) << 2 | uint64_t(cached) << 1);
+    if(cached)
+      *p++ = uint8_t(slot);
+    else {
+      p = put_varint(p, dt);
+      dt_table_[slot] = dt;
+    }
+    for(std::size_t k = 0; k < flipped_.size(); ++k)
+      p = put_varint(p, k ? flipped_[k] - flipped_[k-1] - 1 : flipped_[k]);
+  }
+
+  fill_pos_ = p - fill_.data();
+
+  prev_time_ = t;
+  if(++since_keyframe_ == keyframe_interval_) since_keyframe_ = 0;
+
+  if(fill_pos_ >= CHUNK_SIZE) hand_off();
+}
+
+/*---------------------------------------------------------------------------
+ *  StateDumpReader
+ *-------------------------------------------------------------------------*/
+static const char        DUMP_INDEX_MAGIC[8]  = { 'D','I','C','E','I','D','X','2' };
+static const std::size_t DELTA_HEADER_SIZE    = sizeof DELTA_DUMP_MAGIC + 8;
+
+static uint64_t get_u64(const uint8_t* b)
+{
+  uint64_t v = 0;
+  for(int i = 7; i >= 0; i--) v = v << 8 | b[i];
+  return v;
+}
+
+static bool get_varint(const uint8_t*& p, const uint8_t* end, uint64_t& v)
+{
+  v = 0;
+  for(int shift = 0; shift < 64 && p < end; shift += 7) {
+    uint8_t c = *p++;
+    v |= uint64_t(c & 0x7f) << shift;
+    if(!(c & 0x80)) return true;
+  }
+  return false;
+}
+
+StateDumpReader::StateDumpReader(const std::string& file, unsigned raw_chip_count)
+: fd_(-1)
+, map_(nullptr)
+, size_(0)
+, mtime_(0)
+, format_(DumpFormat::Raw)
+, chip_count_(raw_chip_count)
+, keyframe_interval_(1)
+, sample_count_(0)
+, row_ptr_(nullptr)
+, dt_table_(DELTA_DUMP_TABLE_SIZE, 0)
+, sample_(~0ull)
+, time_(0)
+, keyframe_(false)
+, started_(false)
+{
+  fd_ = open(file.c_str(), O_RDONLY);
+  if(fd_ < 0) throw std::runtime_error("StateDumpReader: cannot open " + file);
+
+  struct stat st;
+  if(fstat(fd_, &st) != 0) {
+    close(fd_);
+    throw std::runtime_error("StateDumpReader: cannot stat " + file);
+  }
+  size_ = st.st_size;
+  mtime_ = uint64_t(st.st_mtim.tv_sec) * 1000000000ull + st.st_mtim.tv_nsec;
+
+  if(size_ != 0) {
+    void* m = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if(m == MAP_FAILED) {
+      close(fd_);
+      throw std::runtime_error("StateDumpReader: cannot map " + file);
+    }
+    map_ = static_cast<const uint8_t*>(m);
+  }
+
+  if(size_ >= DELTA_HEADER_SIZE && memcmp(map_, DELTA_DUMP_MAGIC, sizeof DELTA_DUMP_MAGIC) == 0) {
+    format_            = DumpFormat::Delta;
+    chip_count_        = get_u32(map_ + sizeof DELTA_DUMP_MAGIC);
+    keyframe_interval_ = std::max(get_u32(map_ + sizeof DELTA_DUMP_MAGIC + 4), 1u);
+  }
+  else if(raw_chip_count == 0) {
+    if(map_) munmap(const_cast<uint8_t*>(map_), size_);
+    close(fd_);
+    throw std::runtime_error("StateDumpReader: " + file + " is a raw dump, chip count required");
+  }
+
+  row_size_ = (chip_count_ + 7) >> 3;
+  row_.assign(row_size_, 0);
+  prev_row_.assign(row_size_, 0);
+
+  if(format_ == DumpFormat::Raw) {
+    sample_count_ = size_ / (8 + row_size_);
+    pos_ = map_;
+    end_ = map_ + sample_count_ * (8 + row_size_);
+  }
+  else {
+    if(!load_index(file)) {
+      build_index();
+      save_index(file);
+    }
+    pos_ = map_ + DELTA_HEADER_SIZE;
+    row_ptr_ = row_.data();
+  }
+}
+
+StateDumpReader::~StateDumpReader()
+{
+  if(map_) munmap(const_cast<uint8_t*>(map_), size_);
+  if(fd_ >= 0) close(fd_);
+  map_ = nullptr;
+  fd_ = -1;
+}
+
+/* Skip one Delta record, tracking its time. nullptr if it is truncated. */
+const uint8_t* StateDumpReader::skip_record(const uint8_t* p, uint64_t& time, std::vector<uint64_t>& dt_table) const
+{
+  const uint8_t* end = map_ + size_;
+  uint64_t h, dt, gap;
+
+  if(!get_varint(p, end, h)) return nullptr;
+
+  if(h & 1) {
+    if(std::size_t(end - p) < 8 + row_size_) return nullptr;
+    time = get_u64(p);
+    std::fill(dt_table.begin(), dt_table.end(), 0);
+    return p + 8 + row_size_;
+  }
+
+  if(h & 2) {
+    if(p >= end) return nullptr;
+    dt = dt_table[*p++];
+  }
+  else {
+    if(!get_varint(p, end, dt)) return nullptr;
+    dt_table[delta_dump_slot(dt)] = dt;
+  }
+  time += dt;
+
+  for(uint64_t k = h >> 2; k; k--)
+    if(!get_varint(p, end, gap)) return nullptr;
+
+  return p;
+}
+
+void StateDumpReader::build_index()
+{
+  std::vector<uint64_t> table(DELTA_DUMP_TABLE_SIZE, 0);
+  const uint8_t* p = map_ + DELTA_HEADER_SIZE;
+  const uint8_t* end = map_ + size_;
+  uint64_t time = 0;
+
+  keyframes_.clear();
+  sample_count_ = 0;
+
+  while(p < end) {
+    bool key = *p == 1;   // Keyframe header is always the single byte 1
+    const uint8_t* rec = p;
+
+    p = skip_record(p, time, table);
+    if(!p) { p = rec; break; }   // Truncated by a crash, stop at the last whole record
+
+    if(key) keyframes_.push_back(Keyframe{time, uint64_t(rec - map_)});
+    sample_count_++;
+  }
+  end_ = p;
+}
+
+bool StateDumpReader::load_index(const std::string& file)
+{
+  std::ifstream in(file + ".idx", std::ios::binary);
+  if(!in) return false;
+
+  uint8_t header[sizeof DUMP_INDEX_MAGIC + 36];
+  in.read(reinterpret_cast<char*>(header), sizeof header);
+  if(!in || memcmp(header, DUMP_INDEX_MAGIC, sizeof DUMP_INDEX_MAGIC) != 0) return false;
+
+  const uint8_t* h = header + sizeof DUMP_INDEX_MAGIC;
+  uint64_t dump_size = get_u64(h);
+  uint64_t mtime     = get_u64(h + 8);
+  uint64_t samples   = get_u64(h + 16);
+  uint64_t end       = get_u64(h + 24);
+  uint32_t count     = get_u32(h + 32);
+  if(dump_size != size_ || mtime != mtime_ || end > size_) return false;   // Dump was rewritten
+
+  std::vector<uint8_t> entries(std::size_t(count) * 16);
+  in.read(reinterpret_cast<char*>(entries.data()), entries.size());
+  if(!in) return false;
+
+  keyframes_.resize(count);
+  for(uint32_t i = 0; i < count; i++) {
+    keyframes_[i].time   = get_u64(&entries[i * 16]);
+    keyframes_[i].offset = get_u64(&entries[i * 16 + 8]);
+    /* A rewrite within the same second on a coarse clock keeps the mtime, the
+       records must still start where the index says */
+    uint64_t offset = keyframes_[i].offset;
+    if(offset < DELTA_HEADER_SIZE || offset >= end || map_[offset] != 1) return false;
+  }
+
+  sample_count_ = samples;
+  end_ = map_ + end;
+  return true;
+}
+
+/* Best effort, the dump may be in a read-only directory */
+void StateDumpReader::save_index(const std::string& file) const
+{
+  std::ofstream out(file + ".idx", std::ios::binary);
+  if(!out) return;
+
+  std::vector<uint8_t> buf(sizeof DUMP_INDEX_MAGIC + 36 + keyframes_.size() * 16);
+  uint8_t* p = std::copy(DUMP_INDEX_MAGIC, DUMP_INDEX_MAGIC + sizeof DUMP_INDEX_MAGIC, buf.data());
+  p = put_u64(p, size_);
+  p = put_u64(p, mtime_);
+  p = put_u64(p, sample_count_);
+  p = put_u64(p, end_ - map_);
+  p = put_u32(p, uint32_t(keyframes_.size()));
+  for(const Keyframe& k : keyframes_) {
+    p = put_u64(p, k.time);
+    p = put_u64(p, k.offset);
+  }
+
+  out.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+}
+
+void StateDumpReader::diff_rows(const uint8_t* prev, const uint8_t* cur)
+{
+  for(std::size_t i = 0; i < row_size_; i++)
+    for(uint8_t diff = prev[i] ^ cur[i]; diff; diff &= diff - 1)
+      changed_.push_back(uint32_t(i * 8 + __builtin_ctz(diff)));
+}
+
+/* Apply the Delta record at pos_ to the current row */
+bool StateDumpReader::decode_record()
+{
+  const uint8_t* p = pos_;
+  uint64_t h, dt, gap;
+
+  changed_.clear();
+  if(p >= end_ || !get_varint(p, end_, h)) return false;
+
+  if(h & 1) {
+    /* Keyframe, diffed against the previous row */
+    if(std::size_t(end_ - p) < 8 + row_size_) return false;
+    time_ = get_u64(p);
+    p += 8;
+    prev_row_.swap(row_);
+    std::copy(p, p + row_size_, row_.begin());
+    p += row_size_;
+    std::fill(dt_table_.begin(), dt_table_.end(), 0);
+    keyframe_ = true;
+    row_ptr_ = row_.data();
+
+    if(started_) diff_rows(prev_row_.data(), row_.data());
+  }
+  else {
+    if(h & 2) {
+      if(p >= end_) return false;
+      dt = dt_table_[*p++];
+    }
+    else {
+      if(!get_varint(p, end_, dt)) return false;
+      dt_table_[delta_dump_slot(dt)] = dt;
+    }
+    time_    += dt;
+    keyframe_ = false;
+
+    uint64_t chip = 0;
+    for(uint64_t k = 0; k < h >> 2; k++) {
+      /* The row is already partly updated, it can't be left as it was */
+      if(!get_varint(p, end_, gap))
+        throw std::runtime_error("StateDumpReader: truncated record");
+      chip = k ? chip + gap + 1 : gap;
+      if(chip >= chip_count_)
+        throw std::runtime_error("StateDumpReader: chip index out of range");
+      row_[chip >> 3] ^= 1u << (chip & 7);
+      changed_.push_back(uint32_t(chip));
+    }
+  }
+
+  pos_ = p;
+  sample_++;
+  started_ = true;
+  return true;
+}
+
+bool StateDumpReader::next()
+{
+  if(sample_ + 1 >= sample_count_) return false;
+
+  if(format_ == DumpFormat::Delta)
+    return decode_record();
+
+  const uint8_t* prev = row_ptr_;
+
+  sample_++;
+  time_    = get_u64(map_ + sample_ * (8 + row_size_));
+  row_ptr_ = map_ + sample_ * (8 + row_size_) + 8;
+
+  changed_.clear();
+  if(started_) diff_rows(prev, row_ptr_);
+  started_ = true;
+  return true;
+}
+
+bool StateDumpReader::seekSample(uint64_t n)
+{
+  if(n >= sample_count_) return false;
+
+  if(format_ == DumpFormat::Raw) {
+    sample_   = n;
+    time_     = get_u64(map_ + n * (8 + row_size_));
+    row_ptr_  = map_ + n * (8 + row_size_) + 8;
+  }
+  else {
+    uint64_t k = n / keyframe_interval_;
+    if(k >= keyframes_.size()) return false;
+
+    pos_     = map_ + keyframes_[k].offset;
+    sample_  = k * keyframe_interval_ - 1;
+    started_ = false;
+
+    while(sample_ != n)
+      if(!decode_record()) return false;
+  }
+
+  changed_.clear();
+  started_ = true;
+  return true;
+}
+
+bool StateDumpReader::seek(uint64_t t)
+{
+  if(format_ == DumpFormat::Raw) {
+    /* Last sample with time <= t */
+    uint64_t lo = 0, hi = sample_count_;
+    while(lo < hi) {
+      uint64_t mid = lo + (hi - lo) / 2;
+      if(get_u64(map_ + mid * (8 + row_size_)) <= t) lo = mid + 1;
+      else hi = mid;
+    }
+    return lo != 0 && seekSample(lo - 1);
+  }
+
+  auto kf = std::upper_bound(keyframes_.begin(), keyframes_.end(), t,
+                             [](uint64_t t, const Keyframe& k) { return t < k.time; });
+  if(kf == keyframes_.begin()) return false;
+  --kf;
+
+  /* Count the records up to t from the keyframe, without decoding rows */
+  std::vector<uint64_t> table(DELTA_DUMP_TABLE_SIZE, 0);
+  const uint8_t* p = map_ + kf->offset;
+  uint64_t first = uint64_t(kf - keyframes_.begin()) * keyframe_interval_;
+  uint64_t n = first, time = 0;
+
+  for(;;) {
+    const uint8_t* q = skip_record(p, time, table);
+    if(!q || q > end_ || time > t) break;
+    p = q;
+    n++;
+  }
+
+  return seekSample(n - 1);
+}
+
+void StateDumpReader::TransitionIterator::advance()
+{
+  while(i_ >= reader_->changed().size()) {
+    if(!reader_->next()) {
+      reader_ = nullptr;
+      return;
+    }
+    i_ = 0;
+  }
+
+  uint32_t chip = reader_->changed()[i_];
+  cur_ = StateTransition{ reader_->time(), chip, reader_->output(chip) };
+}
+
+/*---------------------------------------------------------------------------
+ *  Converter
+ *-------------------------------------------------------------------------*/
+uint64_t convert_state_dump(const std::string& in_file, const std::string& out_file,
+                            DumpFormat out_format, unsigned raw_chip_count)
+{
+  StateDumpReader reader(in_file, raw_chip_count);
 
-  for(std::size_t i = 0; i < chips.size(); ++i)
-    if(chips[i]->output == 1)                 // 1 = logic‑high
-      row_[i >> 3] |= 1u << (i & 7);
+  StateRecorder recorder(out_file, reader.chipCount(), SampleMode::Tick, out_format);
+  std::vector<uint8_t> outputs(reader.chipCount());
 
-  out_.write(reinterpret_cast<char*>(&t), sizeof t);
-  out_.write(reinterpret_cast<char*>(row_.data()), row_.size());
+  uint64_t samples = 0;
+  while(reader.next()) {
+    for(unsigned i = 0; i < reader.chipCount(); i++)
+      outputs[i] = reader.output(i);
+    recorder.sample(reader.time(), outputs);
+    samples++;
+  }
+  return samples;
 }
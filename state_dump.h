@@ -4,26 +4,226 @@
 #include <fstream>
 #include <vector>
 #include <cstdint>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
 
 class Chip;                       // forward declaration (see chip.h)
 
 /* When to sample */
 enum class SampleMode { Tick, FrameEdge };
 
+/* How samples are stored
+ *
+ * Raw:   per sample, uint64 time_ps + (chip_count+7)/8 byte bitmap
+ *        (bit i of byte i/8 = chip i high). No header.
+ *
+ * Delta: header  "DICEDLT1", uint32 chip_count, uint32 keyframe_interval
+ *        records varint h = (n << 2) | (cached << 1) | keyframe, then
+ *          keyframe: uint64 time_ps + bitmap as in Raw (h = 1)
+ *          delta:    time delta, as one byte slot of the time delta table
+ *                    if cached, else as a varint that is then stored in
+ *                    slot delta_dump_slot(dt); then n varint indices of the
+ *                    chips that flipped, ascending, each stored as the
+ *                    gap from the previous index + 1
+ *        A keyframe starts the file and follows every keyframe_interval
+ *        records and empties the table, so a reader can resume from any
+ *        of them. Integers are little endian, varints are LEB128.
+ */
+enum class DumpFormat { Raw, Delta };
+
+static const char     DELTA_DUMP_MAGIC[8]        = { 'D','I','C','E','D','L','T','1' };
+static const unsigned DELTA_DUMP_KEYFRAME_INTERVAL = 4096;
+static const unsigned DELTA_DUMP_TABLE_SIZE        = 256;
+
+/* Clocks make the same few time deltas recur, a small table catches most */
+inline unsigned delta_dump_slot(uint64_t dt) { return (uint32_t(dt) * 2654435761u) >> 24; }
+
+/* Records samples on the simulation thread into a chunk buffer; full
+ * chunks are swapped with a writer thread that puts them on disk. */
 class StateRecorder {
 public:
   StateRecorder(const std::string& file,
                 unsigned           chip_count,
-                SampleMode         mode = SampleMode::Tick);
+                SampleMode         mode   = SampleMode::Tick,
+                DumpFormat         format = DumpFormat::Raw,
+                unsigned           keyframe_interval = DELTA_DUMP_KEYFRAME_INTERVAL);
 
-  ~StateRecorder();
+  ~StateRecorder();   // Flushes and closes the file
 
+  /* Sample every chip */
   void sample(uint64_t time_ps, const std::vector<Chip*>& chips);
 
-  SampleMode mode() const noexcept { return mode_; }
+  /* Sample where only the chips listed in touched (indices into chips,
+   * duplicates allowed) can have changed since the previous sample */
+  void sample(uint64_t time_ps, const std::vector<Chip*>& chips,
+              const std::vector<uint32_t>& touched);
+
+  /* Same as the first, from one output byte per chip (0 = low) */
+  void sample(uint64_t time_ps, const std::vector<uint8_t>& outputs);
+
+  SampleMode mode()   const noexcept { return mode_; }
+  DumpFormat format() const noexcept { return format_; }
+  bool       failed() const noexcept { return failed_; }   // A write to disk failed
+
+  static const std::size_t CHUNK_SIZE = 1 << 20;
 
 private:
   std::ofstream        out_;
-  std::vector<uint8_t> row_;
+  std::vector<uint8_t> row_;        // Bitmap of the last sample
   SampleMode           mode_;
+  DumpFormat           format_;
+  bool                 started_;
+
+  std::vector<uint8_t>  prev_;      // Output bit of each chip at the last sample
+  std::vector<uint32_t> flipped_;   // Chips that changed in this sample
+
+  /* Delta format state */
+  std::vector<uint64_t> dt_table_;  // Recent time deltas, by delta_dump_slot()
+  uint64_t              prev_time_;
+  unsigned              keyframe_interval_;
+  unsigned              since_keyframe_;
+
+  /* Writer thread */
+  std::vector<uint8_t>    fill_;    // Being filled by sample(), up to fill_pos_
+  std::vector<uint8_t>    drain_;   // Being written by the writer thread, up to drain_size_
+  std::size_t             fill_pos_;
+  std::size_t             drain_size_;
+  bool                    drain_pending_;
+  bool                    quit_;
+  std::atomic<bool>       failed_;
+  std::mutex              mutex_;
+  std::condition_variable cond_;
+  std::thread             writer_;
+
+  /* high(i) tells whether chip i is logic-high */
+  template <class High> void scan(std::size_t n, High high);
+  void flip(uint32_t chip, uint8_t bit);
+  void write(uint64_t t);
+  void hand_off();
+  void writer();
+};
+
+/* One chip changing level, as yielded by StateDumpReader::transitions() */
+struct StateTransition {
+  uint64_t time;
+  uint32_t chip;
+  bool     high;
 };
+
+/* Random-access reader for both formats. The file is memory mapped.
+ * The format is detected from the header; Raw files carry no chip count,
+ * so it has to be passed in for them (ignored for Delta files).
+ *
+ * Raw samples have a fixed size, so seeking is a binary search over the
+ * file and rows point straight into the mapping. Delta files are indexed
+ * by keyframe (time, offset); the index is saved next to the dump as
+ * <file>.idx and reused while the dump's size and modification time
+ * match and every keyframe offset points at a keyframe. A seek finds the
+ * keyframe by binary search and decodes at most keyframe_interval records. */
+class StateDumpReader {
+public:
+  explicit StateDumpReader(const std::string& file, unsigned raw_chip_count = 0);
+  ~StateDumpReader();
+
+  StateDumpReader(const StateDumpReader&) = delete;
+  StateDumpReader& operator=(const StateDumpReader&) = delete;
+
+  /* Advance to the next sample, false at end of file */
+  bool next();
+
+  /* Go to the last sample at or before time_ps, false if there is none */
+  bool seek(uint64_t time_ps);
+
+  /* Go to sample n (0 based), false if past the end */
+  bool seekSample(uint64_t n);
+
+  DumpFormat format()      const noexcept { return format_; }
+  unsigned   chipCount()   const noexcept { return chip_count_; }
+  uint64_t   sampleCount() const noexcept { return sample_count_; }
+  uint64_t   sample()      const noexcept { return sample_; }     // Index of the current sample
+  uint64_t   time()        const noexcept { return time_; }
+  bool       isKeyframe()  const noexcept { return keyframe_; }
+
+  /* Current sample as a Raw bitmap row; for Raw files it points into the
+   * mapping. Valid until the next call that moves the reader. */
+  const uint8_t* row()     const noexcept { return row_ptr_; }
+  std::size_t    rowSize() const noexcept { return row_size_; }
+  bool output(unsigned chip) const { return (row_ptr_[chip >> 3] >> (chip & 7)) & 1; }
+
+  /* Chips that flipped since the previous sample, ascending
+   * (empty for the first sample and right after a seek) */
+  const std::vector<uint32_t>& changed() const noexcept { return changed_; }
+
+  /* Iterates the transitions of the samples after the current one:
+   *   for(const StateTransition& t : reader.transitions()) ... */
+  class TransitionIterator {
+  public:
+    TransitionIterator(StateDumpReader* r = nullptr)
+      : reader_(r), i_(r ? r->changed().size() : 0) { if(r) advance(); }
+
+    const StateTransition& operator*()  const { return cur_; }
+    const StateTransition* operator->() const { return &cur_; }
+    TransitionIterator& operator++() { i_++; advance(); return *this; }
+    bool operator!=(const TransitionIterator& o) const { return reader_ != o.reader_; }
+
+  private:
+    StateDumpReader* reader_;   // nullptr at the end
+    std::size_t      i_;        // Position in reader_->changed()
+    StateTransition  cur_;
+
+    void advance();
+  };
+
+  struct TransitionRange {
+    StateDumpReader* reader;
+    TransitionIterator begin() { return TransitionIterator(reader); }
+    TransitionIterator end()   { return TransitionIterator(); }
+  };
+
+  TransitionRange transitions() { return TransitionRange{this}; }
+
+private:
+  struct Keyframe {
+    uint64_t time;
+    uint64_t offset;    // From the start of the file
+  };
+
+  int                   fd_;
+  const uint8_t*        map_;
+  std::size_t           size_;
+  uint64_t              mtime_;   // Of the dump, in ns, stamped into the index
+  const uint8_t*        pos_;     // Next record
+  const uint8_t*        end_;     // End of the last complete record
+
+  DumpFormat            format_;
+  unsigned              chip_count_;
+  std::size_t           row_size_;
+  unsigned              keyframe_interval_;
+  uint64_t              sample_count_;
+  std::vector<Keyframe> keyframes_;
+
+  const uint8_t*        row_ptr_;
+  std::vector<uint8_t>  row_;     // Decoded Delta row
+  std::vector<uint8_t>  prev_row_;
+  std::vector<uint32_t> changed_;
+  std::vector<uint64_t> dt_table_;
+  uint64_t              sample_;
+  uint64_t              time_;
+  bool                  keyframe_;
+  bool                  started_;
+
+  bool load_index(const std::string& file);
+  void save_index(const std::string& file) const;
+  void build_index();
+  const uint8_t* skip_record(const uint8_t* p, uint64_t& time, std::vector<uint64_t>& dt_table) const;
+  bool decode_record();
+  void diff_rows(const uint8_t* prev, const uint8_t* cur);
+};
+
+/* Re-encode a dump, e.g. Delta -> Raw for tools that expect the old layout.
+ * Returns the number of samples written. */
+uint64_t convert_state_dump(const std::string& in_file, const std::string& out_file,
+                            DumpFormat out_format, unsigned raw_chip_count = 0);
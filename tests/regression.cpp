@@ -0,0 +1,341 @@
+/*--------------------------------------------------------------------
+    DICE 0.9a  –  tests/regression.cpp
+    Runs games headless and checks their frames against known hashes
+--------------------------------------------------------------------*/
+
+#include <phoenix.hpp>
+#include <nall/platform.hpp>
+
+using namespace nall;
+using namespace phoenix;
+
+#include "../circuit.h"
+#include "../circuit_desc.h"
+#include "../game_list.h"
+
+#include "../chips/video_framebuffer.h"
+#include "../chips/audio_null.h"
+#include "../chips/input_null.h"
+#include "../chips/input_injected.h"
+
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+/*====================================================================
+    Global helpers (referenced by chips/rom.cpp)
+====================================================================*/
+static nall::string app_path;
+
+const nall::string& application_path()  { return app_path; }
+Window&             application_window(){ return Window::none(); }
+
+// Frames each game runs for, from power on
+static const unsigned FRAMES = 120;
+
+// Hash of frame FRAMES with no input, for the games that don't need ROM images
+// so the result doesn't depend on what is in roms/. Run dice_test --print for
+// new values when a change is meant to alter what a game draws.
+static const struct { const char* game; uint64_t hash; } golden[] =
+{
+    { "pong",         0xf2f2b14875699a91ull },
+    { "pongdoubles",  0x4e716e33e2be3833ull },
+    { "rebound",      0xb279d41bee232f6dull },
+    { "gotcha",       0x04c2a56ac47de49bull },
+    { "spacerace",    0x87721fe8146b5c2aull },
+    { "tvbasketball", 0x51375669aa9b9d1eull },
+    { "breakout",     0x623a85669aa1b3ebull },
+    { "quadrapong",   0xed541f62f7dcefd8ull },
+    { "crossfire",    0x3052a9a69054afd3ull },
+    { "pinpong",      0xbe970a15abe9ce34ull },
+};
+
+/*====================================================================
+    Helpers
+====================================================================*/
+static void setup(Settings& settings, unsigned queue = Settings::HEAP_QUEUE)
+{
+    settings.throttle = false;
+    settings.event_queue = queue;
+    settings.netlist_images = false; // Built from the netlist every time, nothing is written
+    settings.tuned_hints = false;    // Sizes as the netlist has them, whatever --tune-hints left here
+}
+
+// FNV-1a of the last completed frame
+static uint64_t hash_frame(const VideoFramebuffer& video)
+{
+    const uint8_t* p = video.frame();
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for(size_t i = 0; i < video.frameSize(); i++)
+        hash = (hash ^ p[i]) * 0x100000001b3ull;
+
+    return hash;
+}
+
+// Runs until n more frames are drawn. The frame is the same whatever the step,
+// it is complete once VBLANK is reached.
+static void run_frames(Circuit& circuit, const Video& video, unsigned n)
+{
+    const int64_t step = int64_t(1.0e-3 / Circuit::timescale);
+    const uint32_t end = video.frame_count + n;
+    while(video.frame_count < end)
+        circuit.run(step);
+}
+
+static bool check_frame(const char* what, const VideoFramebuffer& video, uint64_t expected)
+{
+    uint64_t hash = hash_frame(video);
+    if(hash == expected) return true;
+
+    fprintf(stderr, "  %s: frame %016llx, expected %016llx\n", what,
+            (unsigned long long)hash, (unsigned long long)expected);
+    return false;
+}
+
+/*====================================================================
+    Tests, each runs one game and returns true if it passed
+====================================================================*/
+static bool frames(const GameDesc& g, uint64_t expected, unsigned queue)
+{
+    Settings settings;
+    setup(settings, queue);
+
+    InputNull input;
+    VideoFramebuffer video;
+    AudioNull audio;
+
+    Circuit circuit(settings, input, video, audio, g.desc, g.command_line);
+    run_frames(circuit, video, FRAMES);
+
+    return check_frame("frame", video, expected);
+}
+
+static bool test_heap(const GameDesc& g, uint64_t expected)
+{
+    return frames(g, expected, Settings::HEAP_QUEUE);
+}
+
+static bool test_calendar(const GameDesc& g, uint64_t expected)
+{
+    return frames(g, expected, Settings::CALENDAR_QUEUE);
+}
+
+// Saved halfway, the second half runs three times: on from the save, after
+// loading it back, and in another circuit of the game loading it
+static bool test_state(const GameDesc& g, uint64_t expected)
+{
+    Settings settings;
+    setup(settings);
+    settings.copy_custom_data = true; // The two circuits don't share descriptors
+
+    InputNull input;
+    VideoFramebuffer video, other_video;
+    AudioNull audio;
+
+    Circuit circuit(settings, input, video, audio, g.desc, g.command_line);
+    run_frames(circuit, video, FRAMES / 2);
+    nall::serializer state = circuit.saveState();
+
+    run_frames(circuit, video, FRAMES - FRAMES / 2);
+    if(!check_frame("saved", video, expected)) return false;
+
+    if(!circuit.loadState(state))
+    {
+        fprintf(stderr, "  state not loaded\n");
+        return false;
+    }
+    run_frames(circuit, video, FRAMES - FRAMES / 2);
+    if(!check_frame("loaded", video, expected)) return false;
+
+    Circuit other(settings, input, other_video, audio, g.desc, g.command_line);
+    run_frames(other, other_video, 10);
+    if(!other.loadState(state.data(), state.size()))
+    {
+        fprintf(stderr, "  state not loaded in another circuit\n");
+        return false;
+    }
+    run_frames(other, other_video, FRAMES - FRAMES / 2);
+
+    return check_frame("other circuit", other_video, expected);
+}
+
+// Forked halfway, the fork and then the parent run the second half
+static bool test_fork(const GameDesc& g, uint64_t expected)
+{
+    Settings settings;
+    setup(settings);
+    settings.copy_custom_data = true; // Circuit::fork() needs private custom_data
+
+    InputNull input;
+    VideoFramebuffer video, fork_video;
+    AudioNull audio;
+
+    Circuit circuit(settings, input, video, audio, g.desc, g.command_line);
+    run_frames(circuit, video, FRAMES / 2);
+
+    std::unique_ptr<Circuit> fork(circuit.fork(settings, input, fork_video, audio));
+    if(!fork)
+    {
+        fprintf(stderr, "  not forked\n");
+        return false;
+    }
+    run_frames(*fork, fork_video, FRAMES - FRAMES / 2);
+    if(!check_frame("fork", fork_video, expected)) return false;
+
+    run_frames(circuit, video, FRAMES - FRAMES / 2);
+    return check_frame("parent", video, expected);
+}
+
+// Input is set every STEP, some games stop drawing while the coin is held
+static const int64_t STEP = int64_t(1.0 / 60.0 / Circuit::timescale);
+
+// A coin and a start press, then the paddles swept end to end every two seconds
+static void script(InputInjected& input, const Settings& settings, unsigned step)
+{
+    input.clear();
+
+    if(step >= 30 && step < 36) input.setKey(settings.input.coin_start.coin1, true);
+    if(step >= 60 && step < 66) input.setKey(settings.input.coin_start.start1, true);
+
+    double sweep = (step % 120) / 60.0;
+    double pos = sweep < 1.0 ? sweep : 2.0 - sweep;
+    input.setPaddle(0, pos);
+    input.setPaddle(1, 1.0 - pos);
+}
+
+// Played with scripted input while recording a journal, then replayed with no
+// input for as long: the replay must draw the frame the recording did
+static bool test_journal(const GameDesc& g, uint64_t expected)
+{
+    char path[] = "/tmp/dice_test_XXXXXX";
+    int fd = mkstemp(path);
+    if(fd < 0) return false;
+    close(fd);
+
+    uint64_t recorded;
+    {
+        Settings settings;
+        setup(settings);
+
+        InputInjected input;
+        VideoFramebuffer video;
+        AudioNull audio;
+
+        Circuit circuit(settings, input, video, audio, g.desc, g.command_line);
+        circuit.journal.reset(new InputJournal(path, g.command_line, 0));
+        for(unsigned i = 0; i < FRAMES; i++)
+        {
+            script(input, settings, i);
+            circuit.run(STEP);
+        }
+        recorded = hash_frame(video);
+    }
+
+    Settings settings;
+    setup(settings);
+
+    InputNull input;
+    VideoFramebuffer video;
+    AudioNull audio;
+
+    Circuit circuit(settings, input, video, audio, g.desc, g.command_line);
+    circuit.journal.reset(new InputJournal(path));
+    for(unsigned i = 0; i < FRAMES; i++)
+        circuit.run(STEP);
+    remove(path);
+
+    return check_frame("replay", video, recorded);
+}
+
+static bool print_hash(const GameDesc& g, uint64_t expected)
+{
+    Settings settings;
+    setup(settings);
+
+    InputNull input;
+    VideoFramebuffer video;
+    AudioNull audio;
+
+    Circuit circuit(settings, input, video, audio, g.desc, g.command_line);
+    run_frames(circuit, video, FRAMES);
+
+    fprintf(stderr, "    { \"%s\",%*s0x%016llxull },\n", g.command_line, int(13 - strlen(g.command_line)), "",
+            (unsigned long long)hash_frame(video));
+    return true;
+}
+
+typedef bool (*Test)(const GameDesc& g, uint64_t expected);
+
+// Each test runs in its own process, like bench_run() in headless.cpp: games
+// change their static chip descriptors, and rand() starts from the same seed
+static bool run_test(Test test, const GameDesc& g, uint64_t expected)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        if(!freopen("/dev/null", "w", stdout)) _exit(1); // Hide netlist warnings
+        srand(0);
+        _exit(test(g, expected) ? 0 : 1);
+    }
+
+    int status = 0;
+    if(pid < 0 || waitpid(pid, &status, 0) != pid) return false;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/*====================================================================
+    main()
+====================================================================*/
+int main(int argc, char** argv)
+{
+    app_path = dir(realpath(argv[0]));
+
+    const struct { const char* name; Test test; } tests[] =
+    {
+        { "heap",     test_heap },
+        { "calendar", test_calendar },
+        { "state",    test_state },
+        { "fork",     test_fork },
+        { "journal",  test_journal },
+    };
+
+    bool print = argc > 1 && strcmp(argv[1], "--print") == 0;
+
+    unsigned count = 0, failed = 0;
+    for(const auto& entry : golden)
+    {
+        const GameDesc* game = nullptr;
+        for(const GameDesc& g : game_list)
+            if(strcmp(entry.game, g.command_line) == 0)
+                game = &g;
+
+        if(game == nullptr)
+        {
+            printf("%-14s not in the game list\n", entry.game);
+            failed++;
+            continue;
+        }
+
+        if(print)
+        {
+            run_test(print_hash, *game, 0);
+            continue;
+        }
+
+        for(const auto& t : tests)
+        {
+            bool ok = run_test(t.test, *game, entry.hash);
+            printf("%-14s %-10s %s\n", entry.game, t.name, ok ? "ok" : "FAILED");
+            fflush(stdout);
+            count++;
+            if(!ok) failed++;
+        }
+    }
+
+    if(!print) printf("%u of %u tests failed\n", failed, count);
+    return failed ? 1 : 0;
+}